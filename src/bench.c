@@ -0,0 +1,145 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "shell.h"
+
+/*
+   Synthetic workloads for --bench, hand assembled in the style of
+   the .s files under inputs/.  Each is an endless loop built from
+   unconditional instructions only, so it runs for exactly the
+   instruction budget whatever the condition handling does.
+*/
+typedef struct {
+  const char *name;
+  int nwords;
+  const uint32_t *words;
+} bench_workload;
+
+static const uint32_t BENCH_ALU[] = {
+  0xe2811001, /* loop: add r1, r1, #1 */
+  0xe0222001, /*       eor r2, r2, r1 */
+  0xe0433002, /*       sub r3, r3, r2 */
+  0xe1844003, /*       orr r4, r4, r3 */
+  0xe0045001, /*       and r5, r4, r1 */
+  0xe0966001, /*       adds r6, r6, r1 */
+  0xe1560005, /*       cmp r6, r5 */
+  0xeafffff7  /*       b loop */
+};
+
+/* copy 16 words from the data segment to 0x1000 bytes above it */
+static const uint32_t BENCH_MEMCPY[] = {
+  0xe0400000, /* loop: sub r0, r0, r0 */
+  0xe2800201, /*       add r0, r0, #0x10000000 */
+  0xe0411001, /*       sub r1, r1, r1 */
+  0xe2811201, /*       add r1, r1, #0x10000000 */
+  0xe2811a01, /*       add r1, r1, #0x1000 */
+  0xe4902004, 0xe4812004, /* ldr r2, [r0], #4 ; str r2, [r1], #4 */
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xe4902004, 0xe4812004,
+  0xeaffffd9  /*       b loop */
+};
+
+static const uint32_t BENCH_BRANCH[] = {
+  0xeb000005, /* loop: bl f */
+  0xea000000, /* ret:  b l2 */
+  0xe2811001, /*       add r1, r1, #1 */
+  0xe2822001, /* l2:   add r2, r2, #1 */
+  0xea000000, /*       b l3 */
+  0xe2811001, /*       add r1, r1, #1 */
+  0xeafffff8, /* l3:   b loop */
+  0xe2833001, /* f:    add r3, r3, #1 */
+  0xeafffff7  /*       b ret */
+};
+
+#define BENCH_WORKLOAD(name, words) \
+  { name, sizeof(words) / sizeof(words[0]), words }
+
+static const bench_workload BENCH_WORKLOADS[] = {
+  BENCH_WORKLOAD("alu", BENCH_ALU),
+  BENCH_WORKLOAD("memcpy", BENCH_MEMCPY),
+  BENCH_WORKLOAD("branch", BENCH_BRANCH)
+};
+
+#define BENCH_NWORKLOADS (int)(sizeof(BENCH_WORKLOADS) / sizeof(bench_workload))
+
+/* words cleared at the start of text before each workload is loaded */
+#define BENCH_TEXT_WORDS 64
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : bench                                           */
+/*                                                             */
+/* Purpose   : Run every workload for num_instructions with    */
+/*             tracing off and print one line per workload:    */
+/*                                                             */
+/*   bench=<name> mode=<step|block> instrs=<n>                 */
+/*     ns_per_instr=<f> mips=<f> max_rss_kb=<n>                */
+/*                                                             */
+/*             max_rss_kb is the process peak so far, so it    */
+/*             never goes down from one workload to the next.  */
+/*                                                             */
+/***************************************************************/
+void bench (sim_context *ctx, int num_instructions) {
+
+  int i, k;
+  int saved_trace = ctx->TRACE_LEVEL;
+
+  ctx->TRACE_LEVEL = TRACE_NONE;
+  for (i = 0; i < BENCH_NWORKLOADS; i++) {
+    const bench_workload *w = &BENCH_WORKLOADS[i];
+    struct timespec t0, t1;
+    struct rusage usage;
+    double ns;
+    int executed = 0;
+
+    for (k = 0; k < BENCH_TEXT_WORDS; k++)
+      mem_write_32(ctx, MEM_TEXT_START + 4 * k, k < w->nwords ? w->words[k] : 0);
+    for (k = 0; k < ARM_REGS; k++)
+      ctx->CURRENT_STATE.REGS[k] = 0;
+    ctx->CURRENT_STATE.PC = MEM_TEXT_START;
+    ctx->NEXT_STATE = ctx->CURRENT_STATE;
+    ctx->INSTRUCTION_COUNT = 0;
+    ctx->RUN_BIT = TRUE;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (ctx->BLOCK_MODE)
+      executed = run_blocks(ctx, num_instructions);
+    else
+      for (; executed < num_instructions && ctx->RUN_BIT; executed++)
+        cycle(ctx);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    getrusage(RUSAGE_SELF, &usage);
+
+    ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    fprintf(ctx->OUT, "bench=%s mode=%s instrs=%d ns_per_instr=%.3f mips=%.2f max_rss_kb=%ld\n",
+           w->name, ctx->BLOCK_MODE ? "block" : "step", executed,
+           executed ? ns / executed : 0.0,
+           ns > 0 ? executed * 1e3 / ns : 0.0,
+           usage.ru_maxrss);
+  }
+  ctx->TRACE_LEVEL = saved_trace;
+}
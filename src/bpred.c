@@ -0,0 +1,327 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "bpred.h"
+
+/* branch PCs listed in the report, most mispredicted first */
+#define BPRED_TOP 20
+
+#define NO_TARGET 0xffffffffu	/* predicted target unknown */
+
+static const char *BPRED_NAMES[] = { "static", "bimodal", "gshare" };
+static const char *KIND_NAMES[BRANCH_KINDS] = { "conditional", "direct", "return", "indirect" };
+
+/* "name" or "name:a" or "name:a:b" into its numbers, -1 if malformed */
+static int parse_part (char *part, const char *name, uint32_t *a, uint32_t *b) {
+
+  size_t n = strlen(name);
+  char *end;
+
+  if (strncasecmp(part, name, n) || (part[n] != '\0' && part[n] != ':'))
+    return -1;
+  part += n;
+  if (*part == ':' && a != NULL) {
+    *a = strtoul(part + 1, &end, 0);
+    if (end == part + 1)
+      return -1;
+    part = end;
+  }
+  if (*part == ':' && b != NULL) {
+    *b = strtoul(part + 1, &end, 0);
+    if (end == part + 1)
+      return -1;
+    part = end;
+  }
+  return *part == '\0' ? 0 : -1;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : bpred_parse                                     */
+/*                                                             */
+/* Purpose   : Read a predictor description: a direction       */
+/*             predictor and/or a return stack,                */
+/*                                                             */
+/*               static | bimodal[:bits] |                     */
+/*               gshare[:bits[:history]]    then [,ras[:depth]]*/
+/*                                                             */
+/*             e.g. "gshare:12:8,ras:16".  bits is log2 of the */
+/*             counter table (default 12), history defaults to */
+/*             bits and depth to 8.  "ras" alone is static     */
+/*             with a return stack.  Returns -1 if malformed.  */
+/*                                                             */
+/***************************************************************/
+int bpred_parse (const char *spec, bpred_config *config) {
+
+  char *text = strdup(spec), *part, *save;
+  int direction = 0, status = 0;
+
+  config->kind = BPRED_STATIC;
+  config->bits = 12;
+  config->history = 0xffffffffu;
+  config->ras = 0;
+
+  for (part = strtok_r(text, ",", &save); part != NULL && status == 0;
+       part = strtok_r(NULL, ",", &save)) {
+    if (!direction && !parse_part(part, "static", NULL, NULL))
+      direction = 1;
+    else if (!direction && !parse_part(part, "bimodal", &config->bits, NULL))
+      config->kind = BPRED_BIMODAL, direction = 1;
+    else if (!direction && !parse_part(part, "gshare", &config->bits, &config->history))
+      config->kind = BPRED_GSHARE, direction = 1;
+    else if (config->ras == 0 && !parse_part(part, "ras", &config->ras, NULL)) {
+      if (config->ras == 0)
+        config->ras = 8;
+      direction = 1;		/* nothing may follow but ras, and that only once */
+    }
+    else
+      status = -1;
+  }
+  free(text);
+
+  if (!direction)
+    status = -1;
+  if (config->history == 0xffffffffu)
+    config->history = config->bits;
+  if (config->bits < 1 || config->bits > 24 || config->history > config->bits ||
+      config->ras > 4096)
+    status = -1;
+  return status;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : bpred_enable                                    */
+/*                                                             */
+/* Purpose   : Start predicting with config, from a cold       */
+/*             table and empty counts.                         */
+/*                                                             */
+/***************************************************************/
+void bpred_enable (sim_context *ctx, const bpred_config *config) {
+
+  sim_bpred *b;
+
+  bpred_free(ctx);
+  b = calloc(1, sizeof(sim_bpred));
+  b->config = *config;
+  if (config->kind != BPRED_STATIC) {
+    /* weakly not taken */
+    b->counters = malloc((size_t)1 << config->bits);
+    memset(b->counters, 1, (size_t)1 << config->bits);
+  }
+  if (config->ras != 0)
+    b->stack = calloc(config->ras, sizeof(uint32_t));
+  b->pcs = calloc(BPRED_WORDS, sizeof(bpred_stats));
+  ctx->BPRED = b;
+}
+
+void bpred_free (sim_context *ctx) {
+
+  sim_bpred *b = ctx->BPRED;
+
+  if (b == NULL)
+    return;
+  free(b->counters);
+  free(b->stack);
+  free(b->pcs);
+  free(b);
+  ctx->BPRED = NULL;
+}
+
+/* the kind of PC-writing instruction d is */
+static int branch_kind (const decoded_inst *d) {
+
+  if (d->cls == CLASS_BRANCH)
+    return d->cond == COND_AL ? BRANCH_DIRECT : BRANCH_CONDITIONAL;
+  if (d->op == OP_MOV && d->I == 0 && d->operand2 == 14)
+    return BRANCH_RETURN;
+  if (d->cls == CLASS_TRANSFER && d->L && d->Rd == 15 && d->Rn == 13)
+    return BRANCH_RETURN;
+  return BRANCH_INDIRECT;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : bpred_branch                                    */
+/*                                                             */
+/* Purpose   : Predict the instruction d at pc, which may      */
+/*             write the PC, score the prediction against      */
+/*             next_pc, where it actually went, and train.     */
+/*             Returns 1 if it was mispredicted.               */
+/*                                                             */
+/*             Conditional instructions get their direction    */
+/*             from the predictor, the rest are taken.  A      */
+/*             direct branch's target is known at decode, a    */
+/*             return's comes off the return stack, and        */
+/*             nothing else has a predicted target, so a taken */
+/*             indirect jump always mispredicts.               */
+/*                                                             */
+/***************************************************************/
+int bpred_branch (sim_bpred *b, const decoded_inst *d, uint32_t pc, uint32_t next_pc) {
+
+  int kind, taken, predict_taken, mispredicted;
+  uint32_t index = 0, target = NO_TARGET, word = (pc - MEM_TEXT_START) >> 2;
+  bpred_stats *s;
+
+  if (d->cls == CLASS_SWI)
+    return 0;
+  kind = branch_kind(d);
+  taken = next_pc != pc + 4;
+
+  /* direction */
+  if (d->cond == COND_AL)
+    predict_taken = 1;
+  else if (b->config.kind == BPRED_STATIC)
+    predict_taken = d->cls == CLASS_BRANCH && d->imm24 < 0;
+  else {
+    index = pc >> 2;
+    if (b->config.kind == BPRED_GSHARE)
+      index ^= b->history;
+    index &= (1u << b->config.bits) - 1;
+    predict_taken = b->counters[index] >= 2;
+  }
+
+  /* target */
+  if (d->cls == CLASS_BRANCH)
+    target = pc + 8 + ((uint32_t)d->imm24 << 2);
+  else if (kind == BRANCH_RETURN && b->stack_used > 0)
+    target = b->stack[b->stack_top];
+
+  mispredicted = predict_taken != taken || (taken && target != next_pc);
+
+  /* train */
+  if (d->cond != COND_AL && b->config.kind != BPRED_STATIC) {
+    if (taken && b->counters[index] < 3)
+      b->counters[index]++;
+    else if (!taken && b->counters[index] > 0)
+      b->counters[index]--;
+    b->history = ((b->history << 1) | taken) & ((1u << b->config.history) - 1);
+  }
+  if (b->stack != NULL && taken) {
+    if (d->op == OP_BL) {
+      b->stack_top = (b->stack_top + 1) % b->config.ras;
+      b->stack[b->stack_top] = pc + 4;
+      if (b->stack_used < b->config.ras)
+        b->stack_used++;
+    }
+    else if (kind == BRANCH_RETURN && b->stack_used > 0) {
+      b->stack_top = (b->stack_top + b->config.ras - 1) % b->config.ras;
+      b->stack_used--;
+    }
+  }
+
+  b->kinds[kind].count++;
+  b->kinds[kind].taken += taken;
+  b->kinds[kind].mispredicted += mispredicted;
+  s = word < BPRED_WORDS ? &b->pcs[word] : &b->outside;
+  s->count++;
+  s->taken += taken;
+  s->mispredicted += mispredicted;
+  return mispredicted;
+}
+
+/* one report row, then symbol if there is one */
+static void stats_line (FILE * out, const char *label, const bpred_stats *s, const char *symbol) {
+
+  fprintf(out, "%-12s %12llu %12llu %12llu", label, (unsigned long long)s->count,
+          (unsigned long long)s->taken, (unsigned long long)s->mispredicted);
+  if (s->count == 0)
+    fprintf(out, "        -");
+  else
+    fprintf(out, " %7.2f%%", 100.0 * s->mispredicted / s->count);
+  fprintf(out, "%s%s\n", symbol[0] ? "  " : "", symbol);
+}
+
+/* a text word and its mispredictions, for sorting */
+typedef struct {
+  uint64_t mispredicted;
+  uint32_t word;
+} bpred_entry;
+
+/* most mispredictions first, then lowest PC */
+static int by_mispredicts (const void *a, const void *b) {
+
+  const bpred_entry *x = a, *y = b;
+
+  if (x->mispredicted != y->mispredicted)
+    return x->mispredicted < y->mispredicted ? 1 : -1;
+  return (x->word > y->word) - (x->word < y->word);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : bpred_report                                    */
+/*                                                             */
+/* Purpose   : Print the predictor, mispredict rates by kind   */
+/*             of branch and the BPRED_TOP most mispredicted   */
+/*             branch PCs.                                     */
+/*                                                             */
+/***************************************************************/
+void bpred_report (sim_context *ctx, FILE * out) {
+
+  sim_bpred *b = ctx->BPRED;
+  bpred_stats total;
+  bpred_entry *order;
+  uint32_t n = 0, i;
+  char *name;
+  int k;
+
+  fprintf(out, "Branch prediction : %s", BPRED_NAMES[b->config.kind]);
+  if (b->config.kind != BPRED_STATIC)
+    fprintf(out, ", %u counters", 1u << b->config.bits);
+  if (b->config.kind == BPRED_GSHARE)
+    fprintf(out, ", %u history bits", b->config.history);
+  if (b->config.ras != 0)
+    fprintf(out, ", %u entry return stack", b->config.ras);
+  fprintf(out, "\n-------------------------------------\n");
+  fprintf(out, "%-12s %12s %12s %12s %8s\n", "Kind", "branches", "taken", "mispredicted", "rate");
+  memset(&total, 0, sizeof(total));
+  for (k = 0; k < BRANCH_KINDS; k++) {
+    stats_line(out, KIND_NAMES[k], &b->kinds[k], "");
+    total.count += b->kinds[k].count;
+    total.taken += b->kinds[k].taken;
+    total.mispredicted += b->kinds[k].mispredicted;
+  }
+  stats_line(out, "total", &total, "");
+
+  for (i = 0; i < BPRED_WORDS; i++)
+    n += b->pcs[i].count != 0;
+  order = malloc((n + 1) * sizeof(bpred_entry));
+  for (i = 0, n = 0; i < BPRED_WORDS; i++)
+    if (b->pcs[i].count != 0) {
+      order[n].mispredicted = b->pcs[i].mispredicted;
+      order[n++].word = i;
+    }
+  qsort(order, n, sizeof(bpred_entry), by_mispredicts);
+
+  fprintf(out, "\n%-12s %12s %12s %12s %8s  %s\n", "Branch PC", "executed", "taken",
+          "mispredicted", "rate", "symbol");
+  for (i = 0; i < n && i < BPRED_TOP; i++) {
+    uint32_t pc = MEM_TEXT_START + 4 * order[i].word;
+    char label[16];
+
+    sprintf(label, "0x%08x", pc);
+    name = symbol_name(ctx, pc);
+    stats_line(out, label, &b->pcs[order[i].word], name);
+    free(name);
+  }
+  if (n > BPRED_TOP)
+    fprintf(out, "... %u more\n", n - BPRED_TOP);
+  if (b->outside.count != 0)
+    stats_line(out, "outside text", &b->outside, "");
+  fprintf(out, "\n");
+  free(order);
+}
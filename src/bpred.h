@@ -0,0 +1,67 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_BPRED_H_
+#define _SIM_BPRED_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "decode.h"
+
+/*
+   Branch prediction model (--bpred), hung off ctx->BPRED while
+   enabled.  execute() hands it every instruction that may write the
+   PC, after it ran, with the PC it left behind; the model predicts
+   that outcome from what it had seen before and then trains on it.
+   Nothing it predicts changes what the program does.
+*/
+#define BPRED_STATIC  0		/* backward direct branches taken, the rest not */
+#define BPRED_BIMODAL 1		/* 2-bit counter per PC */
+#define BPRED_GSHARE  2		/* 2-bit counter per PC xor global history */
+
+typedef struct {
+  int kind;			/* BPRED_STATIC ... */
+  uint32_t bits;		/* log2 counters (bimodal, gshare) */
+  uint32_t history;		/* global history bits (gshare) */
+  uint32_t ras;			/* return stack entries, 0 for none */
+} bpred_config;
+
+/* what a PC-writing instruction is, for the report */
+#define BRANCH_CONDITIONAL 0	/* B or BL with a condition */
+#define BRANCH_DIRECT      1	/* B or BL always */
+#define BRANCH_RETURN      2	/* MOV pc, lr or LDR pc, [sp ...] */
+#define BRANCH_INDIRECT    3	/* anything else writing R15 */
+#define BRANCH_KINDS       4
+
+typedef struct {
+  uint64_t count, taken, mispredicted;
+} bpred_stats;
+
+#define BPRED_WORDS (MEM_TEXT_SIZE >> 2)
+
+typedef struct sim_bpred {
+  bpred_config config;
+  uint8_t *counters;		/* 1 << bits two-bit counters */
+  uint32_t history;		/* last outcomes of conditional branches, newest in bit 0 */
+  uint32_t *stack;		/* return addresses, config.ras of them */
+  uint32_t stack_top, stack_used;	/* circular: overflow drops the oldest */
+  bpred_stats kinds[BRANCH_KINDS];
+  bpred_stats *pcs;		/* per text word, BPRED_WORDS of them */
+  bpred_stats outside;		/* branches outside text */
+} sim_bpred;
+
+int  bpred_parse (const char *spec, bpred_config *config);
+void bpred_enable (sim_context *ctx, const bpred_config *config);
+void bpred_free (sim_context *ctx);
+void bpred_report (sim_context *ctx, FILE * out);
+int  bpred_branch (sim_bpred *b, const decoded_inst *d, uint32_t pc, uint32_t next_pc);
+
+#endif
@@ -0,0 +1,191 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "btrace.h"
+
+/* records are built straight into this much buffer between writes */
+#define BTRACE_BUFFER (1 << 20)
+
+/*
+   Trace writer, hung off ctx->BTRACE while --trace-file is on.  It
+   keeps the reader's view of the machine (registers, flags, the last
+   pc and access address, the word table) to encode each record
+   against.
+*/
+typedef struct sim_btrace {
+  FILE *file;
+  char *filename;
+  uint8_t *buffer;
+  size_t used;
+  uint32_t pc;
+  uint32_t regs[ARM_REGS - 1];
+  uint32_t nzcv;
+  uint32_t address;
+  btrace_words words;
+
+  /* the access made by the instruction being recorded */
+  int access;			/* 0, BTRACE_LOAD or BTRACE_STORE */
+  int access_size;
+  uint32_t access_address, access_value;
+} sim_btrace;
+
+static void btrace_flush (sim_btrace *t) {
+
+  if (t->used != 0 && fwrite(t->buffer, 1, t->used, t->file) != t->used)
+    fprintf(stderr, "Error: Can't write trace file %s\n", t->filename);
+  t->used = 0;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : btrace_open                                     */
+/*                                                             */
+/* Purpose   : Start writing the binary trace to filename,     */
+/*             replacing any trace already open.  Returns -1   */
+/*             if the file can't be created.                   */
+/*                                                             */
+/***************************************************************/
+int btrace_open (sim_context *ctx, const char *filename) {
+
+  sim_btrace *t;
+  FILE *file;
+
+  if ((file = fopen(filename, "wb")) == NULL) {
+    fprintf(ctx->OUT, "Error: Can't open trace file %s\n", filename);
+    return -1;
+  }
+  btrace_close(ctx);
+  t = calloc(1, sizeof(sim_btrace));
+  t->file = file;
+  t->filename = strdup(filename);
+  t->buffer = malloc(BTRACE_BUFFER);
+  memcpy(t->buffer, BTRACE_MAGIC, 8);
+  t->used = 8;
+  ctx->BTRACE = t;
+  return 0;
+}
+
+void btrace_close (sim_context *ctx) {
+
+  sim_btrace *t = ctx->BTRACE;
+
+  if (t == NULL)
+    return;
+  btrace_flush(t);
+  fclose(t->file);
+  free(t->buffer);
+  free(t->filename);
+  free(t);
+  ctx->BTRACE = NULL;
+}
+
+void btrace_access (sim_context *ctx, uint32_t address, int size, int write, uint32_t value) {
+
+  sim_btrace *t = ctx->BTRACE;
+
+  t->access = write ? BTRACE_STORE : BTRACE_LOAD;
+  t->access_size = size;
+  t->access_address = address;
+  t->access_value = value;
+}
+
+/* the flags and register writes fields from p on, into *header */
+static inline uint8_t *btrace_state (sim_context *ctx, sim_btrace *t, uint8_t *p,
+                                     uint8_t *header, uint32_t nzcv) {
+
+  uint8_t changed[ARM_REGS - 1];
+  int writes = 0, r;
+
+  if (nzcv != t->nzcv) {
+    *header |= BTRACE_FLAGS;
+    *p++ = nzcv;
+    t->nzcv = nzcv;
+  }
+  for (r = 0; r < ARM_REGS - 1; r++)
+    if (ctx->ARCH_STATE.REGS[r] != t->regs[r])
+      changed[writes++] = r;
+  if (writes >= 3)
+    *p++ = writes;
+  for (r = 0; r < writes; r++) {
+    uint32_t value = ctx->ARCH_STATE.REGS[changed[r]];
+
+    *p++ = changed[r];
+    p += varint_put(p, zigzag(value - t->regs[changed[r]]));
+    t->regs[changed[r]] = value;
+  }
+  *header |= (writes < 3 ? writes : 3) << BTRACE_WRITES_SHIFT;
+  return p;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : btrace_step                                     */
+/*                                                             */
+/* Purpose   : Record the instruction word at pc that execute()*/
+/*             just ran, with the flags (nzcv) and registers   */
+/*             it left and any access it made.                 */
+/*                                                             */
+/***************************************************************/
+void btrace_step (sim_context *ctx, uint32_t pc, uint32_t word, int passed, uint32_t nzcv) {
+
+  sim_btrace *t = ctx->BTRACE;
+  uint8_t *start, *p, header = 0;
+
+  if (t->used + BTRACE_RECORD_MAX > BTRACE_BUFFER)
+    btrace_flush(t);
+  start = t->buffer + t->used;
+  p = start + 1;
+
+  if (pc != t->pc + 4) {
+    header |= BTRACE_JUMP;
+    p += varint_put(p, zigzag(pc - (t->pc + 4)));
+  }
+  t->pc = pc;
+  if (!btrace_word_known(&t->words, pc, word)) {
+    header |= BTRACE_WORD;
+    p[0] = word, p[1] = word >> 8, p[2] = word >> 16, p[3] = word >> 24;
+    p += 4;
+  }
+  if (!passed)
+    header |= BTRACE_SKIPPED;
+  if (t->access) {
+    header |= t->access;
+    *p++ = t->access_size;
+    p += varint_put(p, zigzag(t->access_address - t->address));
+    p += varint_put(p, t->access_value);
+    t->address = t->access_address;
+    t->access = 0;
+  }
+  p = btrace_state(ctx, t, p, &header, nzcv);
+
+  *start = header;
+  t->used = p - t->buffer;
+}
+
+/* record registers and flags (nzcv) changed from outside the program */
+void btrace_sync (sim_context *ctx, uint32_t nzcv) {
+
+  sim_btrace *t = ctx->BTRACE;
+  uint8_t *start, *p, header = BTRACE_SYNC;
+
+  if (t == NULL)
+    return;
+  if (t->used + BTRACE_RECORD_MAX > BTRACE_BUFFER)
+    btrace_flush(t);
+  start = t->buffer + t->used;
+  p = btrace_state(ctx, t, start + 1, &header, nzcv);
+  *start = header;
+  t->used = p - t->buffer;
+}
@@ -0,0 +1,131 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_BTRACE_H_
+#define _SIM_BTRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "shell.h"
+
+/*
+   Binary execution trace (--trace-file), written by btrace.c and read
+   by tracedump.c.  After the 8 byte BTRACE_MAGIC the file is one
+   record per executed instruction:
+
+     header   1 byte, BTRACE_* bits below
+     pc       BTRACE_JUMP: zigzag varint of pc - (previous pc + 4),
+              otherwise the next word
+     word     BTRACE_WORD: 4 bytes little endian, otherwise the word
+              last seen at that pc (btrace_words)
+     access   BTRACE_LOAD/BTRACE_STORE: 1 byte size, zigzag varint
+              of the address less the previous access's, varint value
+     flags    BTRACE_FLAGS: 1 byte, the new NZCV in bits 3:0
+     writes   header bits 7:6 registers, 3 meaning a count byte
+              follows; each is 1 byte register number and a zigzag
+              varint of the new value less the old
+
+   Only R0-R14 are written, the PC is the next record's.  Both sides
+   start from all registers, flags and addresses zero, so the first
+   record carries the whole starting state.
+
+   A header with both BTRACE_LOAD and BTRACE_STORE (BTRACE_SYNC) is
+   not an instruction but a state change from outside the program,
+   a restore or the input command: just the flags and writes fields,
+   no pc, word or access.
+*/
+#define BTRACE_MAGIC "ARMTRC01"
+
+#define BTRACE_JUMP    0x01
+#define BTRACE_WORD    0x02
+#define BTRACE_SKIPPED 0x04	/* condition failed */
+#define BTRACE_FLAGS   0x08
+#define BTRACE_LOAD    0x10
+#define BTRACE_STORE   0x20
+#define BTRACE_SYNC    (BTRACE_LOAD | BTRACE_STORE)
+#define BTRACE_WRITES_SHIFT 6
+
+/* longest record: header, pc, word, access, flags, count, 15 writes */
+#define BTRACE_RECORD_MAX (1 + 5 + 4 + (1 + 5 + 5) + 1 + 1 + 15 * (1 + 5))
+
+static inline uint32_t zigzag (int32_t n) {
+  return ((uint32_t)n << 1) ^ (uint32_t)(n >> 31);
+}
+
+static inline int32_t unzigzag (uint32_t n) {
+  return (int32_t)(n >> 1) ^ -(int32_t)(n & 1);
+}
+
+/* 7 bits a byte, low first; returns the bytes written (at most 5) */
+static inline int varint_put (uint8_t *p, uint32_t n) {
+
+  int k = 0;
+
+  while (n >= 0x80) {
+    p[k++] = (n & 0x7f) | 0x80;
+    n >>= 7;
+  }
+  p[k++] = n;
+  return k;
+}
+
+/* decode a varint from p..end into *n; returns bytes read, 0 if cut short */
+static inline int varint_get (const uint8_t *p, const uint8_t *end, uint32_t *n) {
+
+  int k = 0, shift = 0;
+
+  *n = 0;
+  while (p + k < end && k < 5) {
+    *n |= (uint32_t)(p[k] & 0x7f) << shift;
+    if (!(p[k++] & 0x80))
+      return k;
+    shift += 7;
+  }
+  return 0;
+}
+
+/*
+   The last word seen at each pc, direct mapped.  Writer and reader
+   update it identically, so a word only goes into the trace when its
+   slot disagrees.
+*/
+#define BTRACE_WORDS 4096
+
+typedef struct {
+  uint32_t pc[BTRACE_WORDS];
+  uint32_t word[BTRACE_WORDS];
+} btrace_words;
+
+/* 1 if word is what the table says is at pc; records it either way */
+static inline int btrace_word_known (btrace_words *w, uint32_t pc, uint32_t word) {
+
+  uint32_t slot = (pc >> 2) & (BTRACE_WORDS - 1);
+  int known = w->pc[slot] == pc && w->word[slot] == word;
+
+  w->pc[slot] = pc;
+  w->word[slot] = word;
+  return known;
+}
+
+int  btrace_open (sim_context *ctx, const char *filename);
+void btrace_close (sim_context *ctx);
+void btrace_step (sim_context *ctx, uint32_t pc, uint32_t word, int passed, uint32_t nzcv);
+void btrace_access (sim_context *ctx, uint32_t address, int size, int write, uint32_t value);
+void btrace_sync (sim_context *ctx, uint32_t nzcv);
+
+/* a load or store of size bytes at address, for the next record */
+static inline void btrace_data (sim_context *ctx, uint32_t address, int size, int write,
+                                uint32_t value) {
+
+  if (ctx->BTRACE != NULL)
+    btrace_access(ctx, address, size, write, value);
+}
+
+#endif
@@ -0,0 +1,350 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "cache.h"
+
+static const char *REPLACE_NAMES[] = { "lru", "fifo", "random" };
+static const char *WRITE_NAMES[] = { "write-back", "write-through" };
+
+/* "16K", "1M" or plain bytes, 0 if malformed or 4G and up */
+static uint32_t parse_size (const char *text, char **end) {
+
+  unsigned long long value = strtoull(text, end, 0);
+
+  if (*end == text || value > UINT32_MAX)
+    return 0;
+  if (**end == 'K' || **end == 'k')
+    value <<= 10, (*end)++;
+  else if (**end == 'M' || **end == 'm')
+    value <<= 20, (*end)++;
+  return value > UINT32_MAX ? 0 : value;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : cache_parse                                     */
+/*                                                             */
+/* Purpose   : Read a cache description,                       */
+/*                                                             */
+/*               size[:ways[:line[:lru|fifo|random[:wb|wt]]]]  */
+/*                                                             */
+/*             e.g. "16K:4:32:lru:wb".  Missing fields default */
+/*             to 4 ways, 32 byte lines, LRU and write-back.   */
+/*             Returns -1 unless the geometry works out to a   */
+/*             power of two number of sets.                    */
+/*                                                             */
+/***************************************************************/
+int cache_parse (const char *spec, cache_config *config) {
+
+  char *p, *end;
+  unsigned long long ways;
+  uint32_t sets;
+
+  config->ways = 4;
+  config->line = 32;
+  config->replace = CACHE_LRU;
+  config->write = CACHE_WRITE_BACK;
+
+  config->size = parse_size(spec, &end);
+  if (*end == ':') {
+    ways = strtoull(p = end + 1, &end, 0);
+    if (end == p || ways > UINT32_MAX)
+      return -1;
+    config->ways = ways;
+  }
+  if (*end == ':') {
+    config->line = parse_size(p = end + 1, &end);
+    if (end == p)
+      return -1;
+  }
+  if (*end == ':') {
+    p = end + 1;
+    end = p + strcspn(p, ":");
+    for (config->replace = 0; config->replace <= CACHE_RANDOM; config->replace++)
+      if (!strncasecmp(p, REPLACE_NAMES[config->replace], end - p) &&
+          REPLACE_NAMES[config->replace][end - p] == '\0')
+        break;
+    if (config->replace > CACHE_RANDOM)
+      return -1;
+  }
+  if (*end == ':') {
+    p = end + 1;
+    if (!strcasecmp(p, "wb"))
+      config->write = CACHE_WRITE_BACK;
+    else if (!strcasecmp(p, "wt"))
+      config->write = CACHE_WRITE_THROUGH;
+    else
+      return -1;
+    end = p + strlen(p);
+  }
+  if (*end != '\0')
+    return -1;
+
+  /* ways > size / line first, so ways * line can't overflow */
+  if (config->line < 4 || (config->line & (config->line - 1)) != 0 ||
+      config->ways == 0 || config->ways > config->size / config->line ||
+      config->size % (config->ways * config->line) != 0)
+    return -1;
+  sets = config->size / (config->ways * config->line);
+  if (sets == 0 || (sets & (sets - 1)) != 0)
+    return -1;
+  return 0;
+}
+
+static sim_cache *cache_create (const cache_config *config) {
+
+  sim_cache *cache = calloc(1, sizeof(sim_cache));
+  uint32_t lines;
+
+  cache->config = *config;
+  cache->sets = config->size / (config->ways * config->line);
+  while ((1u << cache->line_shift) < config->line)
+    cache->line_shift++;
+  lines = cache->sets * config->ways;
+  cache->tag = malloc(lines * sizeof(uint32_t));
+  memset(cache->tag, 0xff, lines * sizeof(uint32_t));	/* CACHE_INVALID */
+  cache->stamp = calloc(lines, sizeof(uint64_t));
+  cache->dirty = calloc(lines, 1);
+  cache->random = 2463534242u;
+  cache->last_line = CACHE_INVALID;
+  return cache;
+}
+
+static void cache_destroy (sim_cache *cache) {
+
+  if (cache == NULL)
+    return;
+  free(cache->tag);
+  free(cache->stamp);
+  free(cache->dirty);
+  free(cache);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : cache_enable                                    */
+/*                                                             */
+/* Purpose   : Put an empty cache described by config on the   */
+/*             I-side (data 0) or the D-side (data 1),         */
+/*             replacing any cache already there.              */
+/*                                                             */
+/***************************************************************/
+void cache_enable (sim_context *ctx, int data, const cache_config *config) {
+
+  sim_caches *c = ctx->CACHES;
+  int i;
+
+  if (c == NULL) {
+    c = ctx->CACHES = calloc(1, sizeof(sim_caches));
+
+    /* every region starts and ends on a MiB boundary (shell.h) */
+    memset(c->region, MEM_NREGIONS, sizeof(c->region));
+    for (i = 0; i < MEM_NREGIONS; i++) {
+      uint32_t mb;
+
+      for (mb = ctx->MEM_REGIONS[i].start >> 20;
+           mb <= (ctx->MEM_REGIONS[i].start + ctx->MEM_REGIONS[i].size - 1) >> 20; mb++)
+        c->region[mb] = i;
+    }
+  }
+  if (data) {
+    cache_destroy(c->dcache);
+    c->dcache = cache_create(config);
+  }
+  else {
+    cache_destroy(c->icache);
+    c->icache = cache_create(config);
+  }
+}
+
+void cache_free (sim_context *ctx) {
+
+  if (ctx->CACHES == NULL)
+    return;
+  cache_destroy(ctx->CACHES->icache);
+  cache_destroy(ctx->CACHES->dcache);
+  free(ctx->CACHES);
+  ctx->CACHES = NULL;
+}
+
+/* way of the set at base to fill: an empty one, else by policy */
+static uint32_t cache_victim (sim_cache *cache, uint32_t base) {
+
+  uint32_t w, victim = 0;
+
+  for (w = 0; w < cache->config.ways; w++)
+    if (cache->tag[base + w] == CACHE_INVALID)
+      return w;
+
+  if (cache->config.replace == CACHE_RANDOM) {
+    cache->random ^= cache->random << 13;
+    cache->random ^= cache->random >> 17;
+    cache->random ^= cache->random << 5;
+    return cache->random % cache->config.ways;
+  }
+  for (w = 1; w < cache->config.ways; w++)
+    if (cache->stamp[base + w] < cache->stamp[base + victim])
+      victim = w;
+  return victim;
+}
+
+/* look up one line, counting against the region the line is in */
+static void cache_line (sim_caches *c, sim_cache *cache, uint32_t line, int write) {
+
+  cache_stats *s = &cache->stats[c->region[(line << cache->line_shift) >> 20]];
+  uint32_t base = (line & (cache->sets - 1)) * cache->config.ways;
+  uint32_t w, victim;
+
+  cache->clock++;
+  if (write)
+    s->writes++;
+  else
+    s->reads++;
+
+  for (w = 0; w < cache->config.ways; w++)
+    if (cache->tag[base + w] == line) {
+      if (cache->config.replace == CACHE_LRU)
+        cache->stamp[base + w] = cache->clock;
+      if (write && cache->config.write == CACHE_WRITE_BACK)
+        cache->dirty[base + w] = 1;
+      cache->last_line = line;
+      cache->last_way = base + w;
+      cache->last_stats = s;
+      return;
+    }
+
+  if (write)
+    s->write_misses++;
+  else
+    s->read_misses++;
+  if (write && cache->config.write == CACHE_WRITE_THROUGH)
+    return;
+
+  victim = base + cache_victim(cache, base);
+  if (cache->tag[victim] != CACHE_INVALID) {
+    cache_stats *old = &cache->stats[c->region[(cache->tag[victim] << cache->line_shift) >> 20]];
+
+    old->evictions++;
+    if (cache->dirty[victim])
+      old->writebacks++;
+  }
+  cache->tag[victim] = line;
+  cache->dirty[victim] = write;
+  cache->stamp[victim] = cache->clock;
+  cache->last_line = line;
+  cache->last_way = victim;
+  cache->last_stats = s;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : cache_lookup                                    */
+/*                                                             */
+/* Purpose   : cache_access past the last-line check: look up  */
+/*             both lines if the access straddles two.         */
+/*                                                             */
+/***************************************************************/
+void cache_lookup (sim_caches *c, sim_cache *cache, uint32_t address, int size, int write) {
+
+  uint32_t first = address >> cache->line_shift;
+  uint32_t last = (address + size - 1) >> cache->line_shift;
+
+  cache_line(c, cache, first, write);
+  if (last != first)
+    cache_line(c, cache, last, write);
+}
+
+static const char *region_name (uint32_t start) {
+
+  switch (start) {
+  case MEM_TEXT_START:  return "text";
+  case MEM_DATA_START:  return "data";
+  case MEM_STACK_START: return "stack";
+  case MEM_KDATA_START: return "kdata";
+  case MEM_KTEXT_START: return "ktext";
+  }
+  return "?";
+}
+
+static void miss_rate (FILE * out, uint64_t misses, uint64_t accesses) {
+
+  if (accesses == 0)
+    fprintf(out, "        -");
+  else
+    fprintf(out, " %7.2f%%", 100.0 * misses / accesses);
+}
+
+static void cache_print (sim_context *ctx, FILE * out, const char *title, sim_cache *cache) {
+
+  cache_stats total;
+  int i;
+
+  memset(&total, 0, sizeof(total));
+  fprintf(out, "%s : %u bytes, %u-way, %u byte lines, %u sets, %s, %s\n", title,
+          cache->config.size, cache->config.ways, cache->config.line, cache->sets,
+          REPLACE_NAMES[cache->config.replace], WRITE_NAMES[cache->config.write]);
+  fprintf(out, "-------------------------------------\n");
+  fprintf(out, "%-7s %10s %10s %8s %12s %10s %8s %10s %10s\n", "Region", "reads", "misses",
+          "rate", "writes", "misses", "rate", "evictions", "writebacks");
+  for (i = 0; i <= MEM_NREGIONS; i++) {
+    cache_stats *s = &cache->stats[i];
+
+    total.reads += s->reads;
+    total.read_misses += s->read_misses;
+    total.writes += s->writes;
+    total.write_misses += s->write_misses;
+    total.evictions += s->evictions;
+    total.writebacks += s->writebacks;
+    if (s->reads + s->writes + s->evictions == 0)
+      continue;
+    fprintf(out, "%-7s", i < MEM_NREGIONS ? region_name(ctx->MEM_REGIONS[i].start) : "other");
+    fprintf(out, " %10llu %10llu", (unsigned long long)s->reads,
+            (unsigned long long)s->read_misses);
+    miss_rate(out, s->read_misses, s->reads);
+    fprintf(out, " %12llu %10llu", (unsigned long long)s->writes,
+            (unsigned long long)s->write_misses);
+    miss_rate(out, s->write_misses, s->writes);
+    fprintf(out, " %10llu %10llu\n", (unsigned long long)s->evictions,
+            (unsigned long long)s->writebacks);
+  }
+  fprintf(out, "total   %10llu %10llu", (unsigned long long)total.reads,
+          (unsigned long long)total.read_misses);
+  miss_rate(out, total.read_misses, total.reads);
+  fprintf(out, " %12llu %10llu", (unsigned long long)total.writes,
+          (unsigned long long)total.write_misses);
+  miss_rate(out, total.write_misses, total.writes);
+  fprintf(out, " %10llu %10llu\n\n", (unsigned long long)total.evictions,
+          (unsigned long long)total.writebacks);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : cache_report                                    */
+/*                                                             */
+/* Purpose   : Print each enabled cache's geometry and its     */
+/*             hits and misses per memory region.  Evictions   */
+/*             count against the region of the line evicted.   */
+/*                                                             */
+/***************************************************************/
+void cache_report (sim_context *ctx, FILE * out) {
+
+  sim_caches *c = ctx->CACHES;
+
+  if (c->icache != NULL)
+    cache_print(ctx, out, "L1 I-cache", c->icache);
+  if (c->dcache != NULL)
+    cache_print(ctx, out, "L1 D-cache", c->dcache);
+}
@@ -0,0 +1,117 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_CACHE_H_
+#define _SIM_CACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "shell.h"
+
+/*
+   L1 cache models (--icache, --dcache), hung off ctx->CACHES while
+   enabled.  They only keep tags and count what would hit: memory
+   itself is always read and written through mem_read_32 and friends.
+   The I-side sees every instruction fetched by execute(), the D-side
+   every load and store made by the isa.h handlers.
+*/
+#define CACHE_LRU    0		/* replace the least recently used way */
+#define CACHE_FIFO   1		/* replace the oldest fill */
+#define CACHE_RANDOM 2
+
+#define CACHE_WRITE_BACK    0	/* write-allocate, dirty lines written back */
+#define CACHE_WRITE_THROUGH 1	/* no-write-allocate, stores go to memory */
+
+typedef struct {
+  uint32_t size;		/* bytes */
+  uint32_t ways;
+  uint32_t line;		/* bytes, a power of two */
+  int replace;			/* CACHE_LRU ... */
+  int write;			/* CACHE_WRITE_BACK or CACHE_WRITE_THROUGH */
+} cache_config;
+
+typedef struct {
+  uint64_t reads, read_misses;
+  uint64_t writes, write_misses;
+  uint64_t evictions;		/* valid lines of this region replaced */
+  uint64_t writebacks;		/* ... of which were dirty */
+} cache_stats;
+
+/*
+   One cache.  The tag store is struct-of-arrays, sets * ways entries
+   each with the ways of a set next to each other, so a lookup scans
+   one short run of tag words.  A tag is the whole line number
+   (address / line), CACHE_INVALID for an empty way.
+*/
+#define CACHE_INVALID 0xffffffffu
+
+typedef struct {
+  cache_config config;
+  uint32_t sets;
+  uint32_t line_shift;
+  uint32_t *tag;
+  uint64_t *stamp;		/* last use (LRU) or fill (FIFO) */
+  uint8_t *dirty;
+  uint64_t clock;
+  uint32_t last_line;		/* line of the last access, still resident */
+  uint32_t last_way;		/* ... its tag index */
+  cache_stats *last_stats;	/* ... and its region's counters */
+  uint32_t random;		/* xorshift state for CACHE_RANDOM */
+  cache_stats stats[MEM_NREGIONS + 1];	/* per MEM_REGIONS entry, then unmapped */
+} sim_cache;
+
+typedef struct sim_caches {
+  sim_cache *icache, *dcache;	/* NULL when that side is off */
+  uint8_t region[1 << 12];	/* MEM_REGIONS index per MiB of guest space */
+} sim_caches;
+
+int  cache_parse (const char *spec, cache_config *config);
+void cache_enable (sim_context *ctx, int data, const cache_config *config);
+void cache_free (sim_context *ctx);
+void cache_report (sim_context *ctx, FILE * out);
+void cache_lookup (sim_caches *c, sim_cache *cache, uint32_t address, int size, int write);
+
+/*
+   Run one access of size bytes at address through cache.  Most
+   accesses land in the line the previous one did, which is already
+   the most recently used in its set: those only count a hit.
+*/
+static inline void cache_access (sim_caches *c, sim_cache *cache, uint32_t address, int size,
+                                 int write) {
+
+  if ((address >> cache->line_shift) == cache->last_line &&
+      ((address + size - 1) >> cache->line_shift) == cache->last_line) {
+    if (write) {
+      cache->last_stats->writes++;
+      if (cache->config.write == CACHE_WRITE_BACK)
+        cache->dirty[cache->last_way] = 1;
+    }
+    else
+      cache->last_stats->reads++;
+    return;
+  }
+  cache_lookup(c, cache, address, size, write);
+}
+
+/* an instruction fetch from pc */
+static inline void cache_fetch (sim_context *ctx, uint32_t pc) {
+
+  if (ctx->CACHES != NULL && ctx->CACHES->icache != NULL)
+    cache_access(ctx->CACHES, ctx->CACHES->icache, pc, 4, 0);
+}
+
+/* a load or store of size bytes at address */
+static inline void cache_data (sim_context *ctx, uint32_t address, int size, int write) {
+
+  if (ctx->CACHES != NULL && ctx->CACHES->dcache != NULL)
+    cache_access(ctx->CACHES, ctx->CACHES->dcache, address, size, write);
+}
+
+#endif
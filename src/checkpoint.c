@@ -0,0 +1,232 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shell.h"
+#include "profile.h"
+#include "cache.h"
+#include "bpred.h"
+#include "timing.h"
+#include "btrace.h"
+
+/*
+   Checkpoint file layout, host byte order:
+
+     0                  checkpoint_header
+     region[i].offset   MEM_REGIONS[i] contents, region[i].size bytes
+
+   Region data starts on a CHECKPOINT_ALIGN boundary so restore can map
+   it copy-on-write straight over the region, on hosts with pages up to
+   that size.  All-zero pages are never written, leaving holes, so a
+   checkpoint costs disk only for the memory a program touched.
+*/
+#define CHECKPOINT_MAGIC "ARMv4CK1"
+#define CHECKPOINT_ALIGN 0x10000
+#define CHECKPOINT_PAGE  4096
+
+typedef struct {
+  char magic[8];
+  uint32_t num_regions;
+  uint32_t run_bit;
+  uint64_t instruction_count;
+  CPU_State state;
+  struct {
+    uint32_t start, size;
+    uint64_t offset;
+  } region[MEM_NREGIONS];
+} checkpoint_header;
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+
+static int page_is_zero (const uint8_t *page) {
+
+  static const uint8_t zero[CHECKPOINT_PAGE];
+
+  return !memcmp(page, zero, CHECKPOINT_PAGE);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : checkpoint                                      */
+/*                                                             */
+/* Purpose   : Save registers, counters and memory to          */
+/*             filename.  The file is written under a          */
+/*             temporary name and renamed, so a machine        */
+/*             restored from filename keeps its pages.         */
+/*             Returns -1 on failure.                          */
+/*                                                             */
+/***************************************************************/
+int checkpoint (sim_context *ctx, char *filename) {
+
+  checkpoint_header header;
+  char *temp = malloc(strlen(filename) + 5);
+  uint64_t offset = ALIGN_UP(sizeof(header), CHECKPOINT_ALIGN);
+  uint32_t page;
+  int fd, i, failed = 0;
+
+  sprintf(temp, "%s.tmp", filename);
+  if ((fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    fprintf(ctx->OUT, "Error: Can't create checkpoint file %s\n", temp);
+    free(temp);
+    return -1;
+  }
+
+  flags_sync(ctx);
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.num_regions = MEM_NREGIONS;
+  header.run_bit = ctx->RUN_BIT;
+  header.instruction_count = ctx->INSTRUCTION_COUNT;
+  header.state = ctx->CURRENT_STATE;
+  for (i = 0; i < MEM_NREGIONS; i++) {
+    mem_region_t *r = &ctx->MEM_REGIONS[i];
+
+    header.region[i].start = r->start;
+    header.region[i].size = r->size;
+    header.region[i].offset = offset;
+    for (page = 0; page < r->size && !failed; page += CHECKPOINT_PAGE)
+      if (!page_is_zero(r->mem + page) &&
+          pwrite(fd, r->mem + page, CHECKPOINT_PAGE, offset + page) != CHECKPOINT_PAGE)
+        failed = 1;
+    offset = ALIGN_UP(offset + r->size, CHECKPOINT_ALIGN);
+  }
+
+  if (failed || pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      ftruncate(fd, offset) < 0 || close(fd) < 0 || rename(temp, filename) < 0) {
+    fprintf(ctx->OUT, "Error: Can't write checkpoint file %s\n", filename);
+    unlink(temp);
+    free(temp);
+    return -1;
+  }
+  free(temp);
+
+  fprintf(ctx->OUT, "Checkpoint written to %s at instruction %llu.\n\n",
+          filename, (unsigned long long)ctx->INSTRUCTION_COUNT);
+  return 0;
+}
+
+/*
+   Start every model that is on over with the same settings, so its
+   counts cover only the restored run.  The --trace-file trace gets a
+   sync record with the restored registers and flags instead.
+*/
+static void models_restart (sim_context *ctx) {
+
+  if (ctx->PROFILE != NULL) {
+    char *filename = ctx->PROFILE->filename ? strdup(ctx->PROFILE->filename) : NULL;
+
+    profile_enable(ctx, filename);
+    free(filename);
+  }
+  if (ctx->CACHES != NULL) {
+    sim_caches *c = ctx->CACHES;
+    cache_config icache, dcache;
+    int has_icache = c->icache != NULL, has_dcache = c->dcache != NULL;
+
+    if (has_icache)
+      icache = c->icache->config;
+    if (has_dcache)
+      dcache = c->dcache->config;
+    cache_free(ctx);
+    if (has_icache)
+      cache_enable(ctx, 0, &icache);
+    if (has_dcache)
+      cache_enable(ctx, 1, &dcache);
+  }
+  if (ctx->BPRED != NULL) {
+    bpred_config predictor = ctx->BPRED->config;
+
+    bpred_enable(ctx, &predictor);
+  }
+  if (ctx->TIMING != NULL) {
+    timing_config timing = ctx->TIMING->config;
+
+    timing_enable(ctx, &timing);
+  }
+  btrace_sync(ctx, ctx->CURRENT_STATE.CPSR >> 28);	/* flags in CPSR */
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : restore                                         */
+/*                                                             */
+/* Purpose   : Load a checkpoint written by checkpoint().      */
+/*             Memory is mapped private from the file, so      */
+/*             pages are only read when the program touches    */
+/*             them.  The machine is unchanged if the file     */
+/*             doesn't match its memory map.  Profile, cache,  */
+/*             branch predictor and timing models start over.  */
+/*             Returns -1 on failure.                          */
+/*                                                             */
+/***************************************************************/
+int restore (sim_context *ctx, char *filename) {
+
+  checkpoint_header header;
+  long host_page = sysconf(_SC_PAGESIZE);
+  off_t file_size;
+  int fd, i;
+
+  if ((fd = open(filename, O_RDONLY)) < 0) {
+    fprintf(ctx->OUT, "Error: Can't open checkpoint file %s\n", filename);
+    return -1;
+  }
+  file_size = lseek(fd, 0, SEEK_END);
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) ||
+      header.num_regions != MEM_NREGIONS) {
+    fprintf(ctx->OUT, "Error: %s is not a checkpoint\n", filename);
+    close(fd);
+    return -1;
+  }
+  for (i = 0; i < MEM_NREGIONS; i++)
+    if (header.region[i].start != ctx->MEM_REGIONS[i].start ||
+        header.region[i].size != ctx->MEM_REGIONS[i].size ||
+        header.region[i].offset + header.region[i].size > (uint64_t)file_size) {
+      fprintf(ctx->OUT, "Error: %s was saved with a different memory map\n", filename);
+      close(fd);
+      return -1;
+    }
+
+  for (i = 0; i < MEM_NREGIONS; i++) {
+    mem_region_t *r = &ctx->MEM_REGIONS[i];
+
+    if (host_page > 0 && header.region[i].offset % host_page == 0 &&
+        mmap(r->mem, r->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, header.region[i].offset) != MAP_FAILED)
+      continue;
+    /* pages too large to map from this file: read it instead */
+    mmap(r->mem, r->size, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    if (pread(fd, r->mem, r->size, header.region[i].offset) != (ssize_t)r->size)
+      fprintf(ctx->OUT, "Warning: short read from checkpoint file %s\n", filename);
+  }
+  close(fd);
+
+  ctx->CURRENT_STATE = header.state;
+  ctx->NEXT_STATE = header.state;
+  memset(&ctx->FLAGS, 0, sizeof(ctx->FLAGS));	/* flags in CPSR, as sim_create */
+  ctx->RUN_BIT = header.run_bit;
+  ctx->INSTRUCTION_COUNT = header.instruction_count;
+
+  /* every cached decode may be stale now */
+  predecode_free(ctx);
+  predecode_init(ctx);
+  models_restart(ctx);
+
+  fprintf(ctx->OUT, "Restored %s at instruction %llu.\n\n", filename,
+          (unsigned long long)ctx->INSTRUCTION_COUNT);
+  return 0;
+}
@@ -0,0 +1,195 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_DECODE_H_
+#define _SIM_DECODE_H_
+
+#include <stdint.h>
+
+/*
+    Instruction classes, selected from bits 27:20 and 7:4 of the word
+
+    1111xxxx          - Software Interrupt
+    101Lxxxx          - Branch, L = 1 for BL
+    01IPUBWL          - Single Data Transfer
+    000000AS ... 1001 - Multiply
+    00IoooooS         - Data Processing
+    anything else     - not implemented by this simulator
+*/
+#define CLASS_DATA      0
+#define CLASS_MUL       1
+#define CLASS_TRANSFER  2
+#define CLASS_BRANCH    3
+#define CLASS_SWI       4
+#define CLASS_UNDEF     5
+
+/* condition field (31:28) that always passes */
+#define COND_AL 0xE
+
+/*
+    Mnemonics.  The first sixteen follow the data processing opcode
+    (24:21) so OP_AND..OP_MVN == opcode; the rest are worked out from
+    the class and the L/B/A bits.
+*/
+enum {
+  OP_AND, OP_EOR, OP_SUB, OP_RSB, OP_ADD, OP_ADC, OP_SBC, OP_RSC,
+  OP_TST, OP_TEQ, OP_CMP, OP_CMN, OP_ORR, OP_MOV, OP_BIC, OP_MVN,
+  OP_LSL, OP_LSR, OP_ASR, OP_ROR,
+  OP_STR, OP_LDR, OP_STRB, OP_LDRB,
+  OP_B, OP_BL, OP_MUL, OP_MLA, OP_SWI, OP_UNDEF,
+  OP_COUNT
+};
+
+static const char *const OP_NAMES[OP_COUNT] = {
+  "AND", "EOR", "SUB", "RSB", "ADD", "ADC", "SBC", "RSC",
+  "TST", "TEQ", "CMP", "CMN", "ORR", "MOV", "BIC", "MVN",
+  "LSL", "LSR", "ASR", "ROR",
+  "STR", "LDR", "STRB", "LDRB",
+  "B", "BL", "MUL", "MLA", "SWI", "UNDEF"
+};
+
+/*
+   Data processing mnemonic indexed by I, opcode and shift type.  Only
+   MOV with a register operand depends on the shift type: the
+   assembler's LSL/LSR/ASR/ROR are MOV Rd, Rm, <shift>.  decode() turns
+   LSL by an immediate 0, a plain MOV Rd, Rm, back into MOV.
+*/
+static const uint8_t DP_OPS[2][16][4] = {
+  { /* I = 0, shifted register operand */
+    { OP_AND, OP_AND, OP_AND, OP_AND },
+    { OP_EOR, OP_EOR, OP_EOR, OP_EOR },
+    { OP_SUB, OP_SUB, OP_SUB, OP_SUB },
+    { OP_RSB, OP_RSB, OP_RSB, OP_RSB },
+    { OP_ADD, OP_ADD, OP_ADD, OP_ADD },
+    { OP_ADC, OP_ADC, OP_ADC, OP_ADC },
+    { OP_SBC, OP_SBC, OP_SBC, OP_SBC },
+    { OP_RSC, OP_RSC, OP_RSC, OP_RSC },
+    { OP_TST, OP_TST, OP_TST, OP_TST },
+    { OP_TEQ, OP_TEQ, OP_TEQ, OP_TEQ },
+    { OP_CMP, OP_CMP, OP_CMP, OP_CMP },
+    { OP_CMN, OP_CMN, OP_CMN, OP_CMN },
+    { OP_ORR, OP_ORR, OP_ORR, OP_ORR },
+    { OP_LSL, OP_LSR, OP_ASR, OP_ROR },
+    { OP_BIC, OP_BIC, OP_BIC, OP_BIC },
+    { OP_MVN, OP_MVN, OP_MVN, OP_MVN }
+  },
+  { /* I = 1, rotated immediate operand */
+    { OP_AND, OP_AND, OP_AND, OP_AND },
+    { OP_EOR, OP_EOR, OP_EOR, OP_EOR },
+    { OP_SUB, OP_SUB, OP_SUB, OP_SUB },
+    { OP_RSB, OP_RSB, OP_RSB, OP_RSB },
+    { OP_ADD, OP_ADD, OP_ADD, OP_ADD },
+    { OP_ADC, OP_ADC, OP_ADC, OP_ADC },
+    { OP_SBC, OP_SBC, OP_SBC, OP_SBC },
+    { OP_RSC, OP_RSC, OP_RSC, OP_RSC },
+    { OP_TST, OP_TST, OP_TST, OP_TST },
+    { OP_TEQ, OP_TEQ, OP_TEQ, OP_TEQ },
+    { OP_CMP, OP_CMP, OP_CMP, OP_CMP },
+    { OP_CMN, OP_CMN, OP_CMN, OP_CMN },
+    { OP_ORR, OP_ORR, OP_ORR, OP_ORR },
+    { OP_MOV, OP_MOV, OP_MOV, OP_MOV },
+    { OP_BIC, OP_BIC, OP_BIC, OP_BIC },
+    { OP_MVN, OP_MVN, OP_MVN, OP_MVN }
+  }
+};
+
+typedef struct {
+
+  uint32_t word;     /* raw instruction word */
+  uint8_t  cls;      /* one of CLASS_* */
+  uint8_t  op;       /* one of OP_* */
+  uint8_t  cond;     /* 31:28 */
+  uint8_t  opcode;   /* 24:21, data processing command */
+  uint8_t  I;        /* 25 */
+  uint8_t  P;        /* 24, transfer pre/post index */
+  uint8_t  U;        /* 23, transfer up/down */
+  uint8_t  B;        /* 22, transfer byte/word */
+  uint8_t  W;        /* 21, transfer write-back */
+  uint8_t  S;        /* 20, set flags (also L for transfers) */
+  uint8_t  L;        /* 20 for transfers, 24 for branches */
+  uint8_t  Rn;       /* 19:16 */
+  uint8_t  Rd;       /* 15:12 */
+  uint8_t  Rs;       /* 11:8 */
+  uint8_t  shamt5;   /* 11:7 */
+  uint8_t  sh;       /* 6:5 */
+  uint8_t  bit4;     /* 4 */
+  uint8_t  Rm;       /* 3:0 */
+  uint16_t operand2; /* 11:0 */
+  int32_t  imm24;    /* 23:0, sign extended */
+  uint8_t  writes_pc; /* may change the PC, so ends a basic block */
+} decoded_inst;
+
+/*
+   Split an instruction word into its fields.  Every field is
+   extracted regardless of class so the handlers can pick the ones
+   they need without decoding the word again.
+*/
+static inline void decode (uint32_t word, decoded_inst *d) {
+
+  d->word     = word;
+  d->cond     = word >> 28;
+  d->opcode   = (word >> 21) & 0xF;
+  d->I        = (word >> 25) & 0x1;
+  d->P        = (word >> 24) & 0x1;
+  d->U        = (word >> 23) & 0x1;
+  d->B        = (word >> 22) & 0x1;
+  d->W        = (word >> 21) & 0x1;
+  d->S        = (word >> 20) & 0x1;
+  d->Rn       = (word >> 16) & 0xF;
+  d->Rd       = (word >> 12) & 0xF;
+  d->Rs       = (word >>  8) & 0xF;
+  d->shamt5   = (word >>  7) & 0x1F;
+  d->sh       = (word >>  5) & 0x3;
+  d->bit4     = (word >>  4) & 0x1;
+  d->Rm       = word & 0xF;
+  d->operand2 = word & 0xFFF;
+  d->imm24    = ((int32_t)(word << 8)) >> 8;
+
+  if ((word & 0x0F000000) == 0x0F000000) {
+    d->cls = CLASS_SWI;
+    d->op = OP_SWI;
+    d->L = 0;
+    d->writes_pc = 1;
+  }
+  else if ((word & 0x0E000000) == 0x0A000000) {
+    d->cls = CLASS_BRANCH;
+    d->L = d->P;
+    d->op = d->L ? OP_BL : OP_B;
+    d->writes_pc = 1;
+  }
+  else if ((word & 0x0C000000) == 0x04000000) {
+    d->cls = CLASS_TRANSFER;
+    d->L = d->S;
+    d->op = OP_STR + (d->B << 1) + d->L;
+    d->writes_pc = (d->L && d->Rd == 15) || ((!d->P || d->W) && d->Rn == 15);
+  }
+  else if ((word & 0x0FC000F0) == 0x00000090) {
+    d->cls = CLASS_MUL;
+    d->op = d->W ? OP_MLA : OP_MUL;
+    d->L = 0;
+    d->writes_pc = 0;
+  }
+  else if ((word & 0x0C000000) == 0x00000000) {
+    d->cls = CLASS_DATA;
+    d->op = DP_OPS[d->I][d->opcode][d->sh];
+    if (d->op == OP_LSL && d->shamt5 == 0 && d->bit4 == 0)
+      d->op = OP_MOV;
+    d->L = 0;
+    /* TST, TEQ, CMP and CMN only set flags */
+    d->writes_pc = d->Rd == 15 && (d->opcode < OP_TST || d->opcode > OP_CMN);
+  }
+  else {
+    d->cls = CLASS_UNDEF;
+    d->op = OP_UNDEF;
+    d->L = 0;
+    d->writes_pc = 0;
+  }
+}
+
+#endif
@@ -0,0 +1,351 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <elf.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shell.h"
+
+/*
+   ELF32 little-endian ARM images, as written by arm-none-eabi-as
+   (relocatable .o) or -ld (executables).  Executables are loaded by
+   program header: every PT_LOAD segment goes to its p_vaddr, which must
+   fall inside one of the memory regions, and page aligned file pages
+   are mapped copy-on-write straight into the region instead of copied.
+   Objects have no addresses yet, so their allocated sections are laid
+   out in order, code from MEM_TEXT_START and everything else from
+   MEM_DATA_START; their relocations are not applied.
+
+   Header fields are read byte by byte so big endian hosts work too.
+*/
+#define ELF_FIELD(base, type, field)                                    \
+  elf_read((const uint8_t *)(base) + offsetof(type, field),             \
+           sizeof(((type *)0)->field))
+
+static uint32_t elf_read (const uint8_t *p, int size) {
+
+  uint32_t value = 0;
+
+  while (size-- > 0)
+    value = (value << 8) | p[size];
+  return value;
+}
+
+/* backing store for [address, address + size), NULL if not in one region */
+static uint8_t *elf_memory (sim_context *ctx, uint32_t address, uint32_t size,
+                            mem_region_t **region) {
+
+  int i;
+
+  for (i = 0; i < MEM_NREGIONS; i++) {
+    mem_region_t *r = &ctx->MEM_REGIONS[i];
+
+    if (address - r->start < r->size && size <= r->size - (address - r->start)) {
+      *region = r;
+      return r->mem + (address - r->start);
+    }
+  }
+  return NULL;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : elf_place                                       */
+/*                                                             */
+/* Purpose   : Put filesz bytes of the file at offset into     */
+/*             guest memory at address, zero up to memsz.      */
+/*             With fd >= 0 whole pages are mapped from the    */
+/*             file rather than copied.  Returns -1 if the     */
+/*             range isn't guest memory.                       */
+/*                                                             */
+/***************************************************************/
+static int elf_place (sim_context *ctx, char *filename, int fd, const uint8_t *image,
+                      uint32_t address, uint32_t offset, uint32_t filesz, uint32_t memsz) {
+
+  long host_page = sysconf(_SC_PAGESIZE);
+  mem_region_t *region;
+  uint8_t *dst = elf_memory(ctx, address, memsz, &region);
+  uint32_t mapped = 0, k;
+
+  if (dst == NULL) {
+    fprintf(ctx->OUT, "Error: %s: 0x%08x..0x%08x is outside simulated memory\n",
+            filename, address, address + memsz - 1);
+    return -1;
+  }
+
+  if (fd >= 0 && host_page > 0 && (dst - region->mem) % host_page == 0 &&
+      offset % host_page == 0) {
+    mapped = filesz - filesz % host_page;
+    if (mapped != 0 &&
+        mmap(dst, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, offset) == MAP_FAILED) {
+      /* a failed MAP_FIXED may have dropped the old pages, put them back */
+      mmap(dst, mapped, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+      mapped = 0;
+    }
+  }
+  memcpy(dst + mapped, image + offset + mapped, filesz - mapped);
+  memset(dst + filesz, 0, memsz - filesz);
+
+  for (k = 0; k < memsz; k += 4)
+    if (address + k - MEM_TEXT_START < MEM_TEXT_SIZE)
+      predecode_invalidate(ctx, address + k);
+  return 0;
+}
+
+static int symbol_compare (const void *a, const void *b) {
+
+  const sim_symbol *x = a, *y = b;
+
+  return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : elf_symbols                                     */
+/*                                                             */
+/* Purpose   : Add the functions, objects and labels from the  */
+/*             symbol table to ctx->SYMBOLS.  section_base     */
+/*             gives each section's load address for objects,  */
+/*             NULL for executables.                           */
+/*                                                             */
+/***************************************************************/
+static void elf_symbols (sim_context *ctx, const uint8_t *image, size_t size,
+                         const uint8_t *shdrs, int shnum, int shentsize,
+                         const uint32_t *section_base) {
+
+  int i;
+
+  for (i = 0; i < shnum; i++) {
+    const uint8_t *sh = shdrs + i * shentsize;
+    const uint8_t *strtab_sh;
+    uint32_t k, offset, count, entsize, str_offset, str_size;
+
+    if (ELF_FIELD(sh, Elf32_Shdr, sh_type) != SHT_SYMTAB)
+      continue;
+    if (ELF_FIELD(sh, Elf32_Shdr, sh_link) >= (uint32_t)shnum)
+      return;
+    strtab_sh = shdrs + ELF_FIELD(sh, Elf32_Shdr, sh_link) * shentsize;
+    str_offset = ELF_FIELD(strtab_sh, Elf32_Shdr, sh_offset);
+    str_size = ELF_FIELD(strtab_sh, Elf32_Shdr, sh_size);
+    offset = ELF_FIELD(sh, Elf32_Shdr, sh_offset);
+    entsize = ELF_FIELD(sh, Elf32_Shdr, sh_entsize);
+    if (entsize < sizeof(Elf32_Sym) || offset > size || str_offset > size ||
+        str_size > size - str_offset || str_size == 0)
+      return;
+    count = (size - offset) / entsize;
+    if (ELF_FIELD(sh, Elf32_Shdr, sh_size) / entsize < count)
+      count = ELF_FIELD(sh, Elf32_Shdr, sh_size) / entsize;
+
+    ctx->SYMBOLS = realloc(ctx->SYMBOLS, (ctx->NUM_SYMBOLS + count) * sizeof(sim_symbol));
+    for (k = 1; k < count; k++) {
+      const uint8_t *sym = image + offset + k * entsize;
+      uint32_t name = ELF_FIELD(sym, Elf32_Sym, st_name);
+      uint32_t shndx = ELF_FIELD(sym, Elf32_Sym, st_shndx);
+      int type = ELF32_ST_TYPE(ELF_FIELD(sym, Elf32_Sym, st_info));
+      const char *s = (const char *)image + str_offset + name;
+      sim_symbol *out = &ctx->SYMBOLS[ctx->NUM_SYMBOLS];
+
+      /* skip section and file symbols and the $a/$d mapping symbols */
+      if ((type != STT_NOTYPE && type != STT_FUNC && type != STT_OBJECT) ||
+          shndx == SHN_UNDEF || (shndx >= SHN_LORESERVE && shndx != SHN_ABS) ||
+          name == 0 || name >= str_size || s[0] == '$' ||
+          memchr(s, '\0', str_size - name) == NULL)
+        continue;
+
+      out->address = ELF_FIELD(sym, Elf32_Sym, st_value);
+      if (section_base != NULL && shndx < (uint32_t)shnum)
+        out->address += section_base[shndx];
+      out->size = ELF_FIELD(sym, Elf32_Sym, st_size);
+      out->name = strdup(s);
+      ctx->NUM_SYMBOLS++;
+    }
+  }
+  qsort(ctx->SYMBOLS, ctx->NUM_SYMBOLS, sizeof(sim_symbol), symbol_compare);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : load_elf                                        */
+/*                                                             */
+/* Purpose   : Load an ELF image that load_program has mapped  */
+/*             at image (fd still open), set the PC to its     */
+/*             entry point and keep its symbols.  Returns -1,  */
+/*             after saying why, if it can't be loaded.        */
+/*                                                             */
+/***************************************************************/
+int load_elf (sim_context *ctx, char *filename, int fd, const uint8_t *image, size_t size) {
+
+  const uint8_t *shdrs = NULL;
+  uint32_t *section_base = NULL;
+  uint32_t entry, phoff, shoff, text = MEM_TEXT_START, data = MEM_DATA_START;
+  int type, phnum, phentsize, shnum, shentsize, i;
+  int pieces = 0, relocations = 0, status = 0;
+
+  if (size < sizeof(Elf32_Ehdr) || image[EI_CLASS] != ELFCLASS32 ||
+      image[EI_DATA] != ELFDATA2LSB ||
+      ELF_FIELD(image, Elf32_Ehdr, e_machine) != EM_ARM) {
+    fprintf(ctx->OUT, "Error: %s is not a little endian ELF32 ARM file\n", filename);
+    return -1;
+  }
+
+  type = ELF_FIELD(image, Elf32_Ehdr, e_type);
+  entry = ELF_FIELD(image, Elf32_Ehdr, e_entry);
+  phoff = ELF_FIELD(image, Elf32_Ehdr, e_phoff);
+  phnum = ELF_FIELD(image, Elf32_Ehdr, e_phnum);
+  phentsize = ELF_FIELD(image, Elf32_Ehdr, e_phentsize);
+  shoff = ELF_FIELD(image, Elf32_Ehdr, e_shoff);
+  shnum = ELF_FIELD(image, Elf32_Ehdr, e_shnum);
+  shentsize = ELF_FIELD(image, Elf32_Ehdr, e_shentsize);
+
+  if (phnum > 0 && (phentsize < (int)sizeof(Elf32_Phdr) || phoff > size ||
+                    (size - phoff) / phentsize < (size_t)phnum))
+    phnum = -1;
+  if (shnum > 0 && (shentsize < (int)sizeof(Elf32_Shdr) || shoff > size ||
+                    (size - shoff) / shentsize < (size_t)shnum))
+    shnum = -1;
+  if (phnum < 0 || shnum < 0 || (type == ET_REL && shnum == 0) ||
+      (type != ET_REL && phnum == 0)) {
+    fprintf(ctx->OUT, "Error: %s: bad ELF program or section headers\n", filename);
+    return -1;
+  }
+  if (shnum > 0)
+    shdrs = image + shoff;
+
+  if (type != ET_REL) {
+    /* executable: segments at their own addresses */
+    for (i = 0; i < phnum && status == 0; i++) {
+      const uint8_t *ph = image + phoff + i * phentsize;
+      uint32_t offset = ELF_FIELD(ph, Elf32_Phdr, p_offset);
+      uint32_t filesz = ELF_FIELD(ph, Elf32_Phdr, p_filesz);
+      uint32_t memsz = ELF_FIELD(ph, Elf32_Phdr, p_memsz);
+
+      if (ELF_FIELD(ph, Elf32_Phdr, p_type) != PT_LOAD || memsz == 0)
+        continue;
+      if (filesz > memsz || offset > size || filesz > size - offset) {
+        fprintf(ctx->OUT, "Error: %s: segment %d runs past the end of the file\n",
+                filename, i);
+        return -1;
+      }
+      status = elf_place(ctx, filename, fd, image,
+                         ELF_FIELD(ph, Elf32_Phdr, p_vaddr), offset, filesz, memsz);
+      pieces++;
+    }
+  }
+  else {
+    /* object: lay the allocated sections out in text and data */
+    section_base = calloc(shnum, sizeof(uint32_t));
+    for (i = 0; i < shnum && status == 0; i++) {
+      const uint8_t *sh = shdrs + i * shentsize;
+      uint32_t sh_type = ELF_FIELD(sh, Elf32_Shdr, sh_type);
+      uint32_t flags = ELF_FIELD(sh, Elf32_Shdr, sh_flags);
+      uint32_t offset = ELF_FIELD(sh, Elf32_Shdr, sh_offset);
+      uint32_t sh_size = ELF_FIELD(sh, Elf32_Shdr, sh_size);
+      uint32_t align = ELF_FIELD(sh, Elf32_Shdr, sh_addralign);
+      uint32_t *cursor = (flags & SHF_EXECINSTR) ? &text : &data;
+
+      if ((sh_type == SHT_REL || sh_type == SHT_RELA) &&
+          ELF_FIELD(sh, Elf32_Shdr, sh_entsize) != 0)
+        relocations += sh_size / ELF_FIELD(sh, Elf32_Shdr, sh_entsize);
+      if (!(flags & SHF_ALLOC) || sh_size == 0)
+        continue;
+      if (sh_type != SHT_NOBITS && (offset > size || sh_size > size - offset)) {
+        fprintf(ctx->OUT, "Error: %s: section %d runs past the end of the file\n",
+                filename, i);
+        status = -1;
+        break;
+      }
+      if (align > 1)
+        *cursor = (*cursor + align - 1) & ~(align - 1);
+      section_base[i] = *cursor;
+      status = elf_place(ctx, filename, -1, image, *cursor, offset,
+                         sh_type == SHT_NOBITS ? 0 : sh_size, sh_size);
+      *cursor += sh_size;
+      pieces++;
+    }
+    entry = MEM_TEXT_START;
+  }
+
+  if (status == 0) {
+    if (shnum > 0)
+      elf_symbols(ctx, image, size, shdrs, shnum, shentsize, section_base);
+    ctx->CURRENT_STATE.PC = entry;
+    fprintf(ctx->OUT, "Loaded %d %s from ELF file, entry 0x%08x, %d symbols.\n",
+            pieces, type == ET_REL ? "sections" : "segments", entry, ctx->NUM_SYMBOLS);
+    if (relocations)
+      fprintf(ctx->OUT, "Warning: %d relocations not applied, link the object to resolve them.\n",
+              relocations);
+    fprintf(ctx->OUT, "\n");
+  }
+  free(section_base);
+  return status;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : symbol_lookup                                   */
+/*                                                             */
+/* Purpose   : The symbol at or nearest below address, NULL if */
+/*             there is none or address is past a sized        */
+/*             symbol's end.                                   */
+/*                                                             */
+/***************************************************************/
+const sim_symbol *symbol_lookup (sim_context *ctx, uint32_t address) {
+
+  int lo = 0, hi = ctx->NUM_SYMBOLS - 1, mid;
+  const sim_symbol *found = NULL;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (ctx->SYMBOLS[mid].address <= address) {
+      found = &ctx->SYMBOLS[mid];
+      lo = mid + 1;
+    }
+    else
+      hi = mid - 1;
+  }
+  if (found != NULL && found->size != 0 && address - found->address >= found->size)
+    return NULL;
+  return found;
+}
+
+/* "name+0x10" for address, "" without symbols; the caller frees it */
+char *symbol_name (sim_context *ctx, uint32_t address) {
+
+  const sim_symbol *s = symbol_lookup(ctx, address);
+  char *name;
+
+  if (s == NULL)
+    return strdup("");
+  name = malloc(strlen(s->name) + 12);
+  if (s->address == address)
+    strcpy(name, s->name);
+  else
+    sprintf(name, "%s+0x%x", s->name, address - s->address);
+  return name;
+}
+
+/* drop the symbols of every file loaded into ctx */
+void free_symbols (sim_context *ctx) {
+
+  int i;
+
+  for (i = 0; i < ctx->NUM_SYMBOLS; i++)
+    free(ctx->SYMBOLS[i].name);
+  free(ctx->SYMBOLS);
+  ctx->SYMBOLS = NULL;
+  ctx->NUM_SYMBOLS = 0;
+}
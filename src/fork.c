@@ -0,0 +1,230 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/*
+   fork-run tries several register settings from the current point
+   without re-simulating the way there: each variant is a forked copy
+   of the whole simulator, sharing memory copy-on-write, that applies
+   its overrides and runs `go'.  A child sends back a fork_result and
+   then its rdump text through a pipe.
+*/
+typedef struct {
+  int status;			/* batch() exit status, 1 if it never ran */
+  uint64_t instruction_count;
+  CPU_State state;
+} fork_result;
+
+typedef struct {
+  char *spec;			/* "r1=5,r2=7" */
+  int reg[ARM_REGS + 1];	/* register numbers, -1 ends the list */
+  uint32_t value[ARM_REGS + 1];
+  pid_t pid;
+  int fd;
+  fork_result result;
+  char *dump;
+} fork_variant;
+
+/* parse "r1=5,r2=0x10,pc=0x400000" into variant, -1 if malformed */
+static int parse_variant (fork_variant *v, char *spec) {
+
+  char *p = spec, *end;
+  int n = 0, r;
+
+  v->spec = spec;
+  while (*p != '\0') {
+    if (n == ARM_REGS)
+      return -1;
+    if (!strncasecmp(p, "pc", 2))
+      r = 15, p += 2;
+    else if (*p == 'r' || *p == 'R') {
+      r = strtol(p + 1, &end, 10);
+      if (end == p + 1 || r < 0 || r >= ARM_REGS)
+        return -1;
+      p = end;
+    }
+    else
+      return -1;
+    if (*p++ != '=')
+      return -1;
+    v->reg[n] = r;
+    v->value[n++] = strtoul(p, &end, 0);
+    if (end == p || (*end != ',' && *end != '\0'))
+      return -1;
+    p = *end == ',' ? end + 1 : end;
+  }
+  v->reg[n] = -1;
+  return 0;
+}
+
+/* child side: apply the overrides, run, report, never return */
+static void fork_child (sim_context *ctx, fork_variant *v, int fd) {
+
+  FILE *pipe_out = fdopen(fd, "w");
+  fork_result result;
+  int k;
+
+  ctx->OUT = fopen("/dev/null", "w");
+  if (ctx->PROFILE != NULL)
+    profile_free(ctx);		/* children would all write the same file */
+  ctx->BTRACE = NULL;		/* the parent's trace, left to the parent */
+  for (k = 0; v->reg[k] >= 0; k++) {
+    ctx->CURRENT_STATE.REGS[v->reg[k]] = v->value[k];
+    ctx->NEXT_STATE.REGS[v->reg[k]] = v->value[k];
+  }
+  result.status = batch(ctx, NULL, NULL, "go");
+  flags_sync(ctx);
+  result.instruction_count = ctx->INSTRUCTION_COUNT;
+  result.state = ctx->CURRENT_STATE;
+
+  fwrite(&result, sizeof(result), 1, pipe_out);
+  ctx->OUT = pipe_out;
+  rdump(ctx, NULL);
+  fflush(pipe_out);
+  _exit(result.status);
+}
+
+/* parent side: read a child's result and dump, then reap it */
+static void fork_collect (fork_variant *v) {
+
+  size_t size = 0, got;
+  char buffer[4096];
+  FILE *in = fdopen(v->fd, "r");
+
+  if (fread(&v->result, sizeof(v->result), 1, in) != 1) {
+    memset(&v->result, 0, sizeof(v->result));
+    v->result.status = 1;
+  }
+  while ((got = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    v->dump = realloc(v->dump, size + got + 1);
+    memcpy(v->dump + size, buffer, got);
+    size += got;
+    v->dump[size] = '\0';
+  }
+  fclose(in);
+  waitpid(v->pid, NULL, 0);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : fork_run                                        */
+/*                                                             */
+/* Purpose   : Run every variant in text ("r1=5,r2=7 r1=6 ...")*/
+/*             to completion in its own forked copy of the     */
+/*             machine, as many at once as there are cores,    */
+/*             and print each one's rdump followed by a table  */
+/*             of the registers that ended up different.  The  */
+/*             machine itself doesn't move.  Returns 1 for a   */
+/*             bad variant, else 0.                            */
+/*                                                             */
+/***************************************************************/
+int fork_run (sim_context *ctx, char *text) {
+
+  fork_variant *v;
+  char *spec, *save;
+  int n = 0, max, first, i, k, fds[2];
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  text = strdup(text);
+  v = calloc(strlen(text) / 2 + 1, sizeof(fork_variant));
+  for (spec = strtok_r(text, " \t\r\n", &save); spec != NULL;
+       spec = strtok_r(NULL, " \t\r\n", &save))
+    if (parse_variant(&v[n++], spec) < 0) {
+      fprintf(ctx->OUT, "Invalid variant %s\n", spec);
+      free(v);
+      free(text);
+      return 1;
+    }
+  if (n == 0) {
+    fprintf(ctx->OUT, "fork-run needs at least one variant\n");
+    free(v);
+    free(text);
+    return 1;
+  }
+
+  fprintf(ctx->OUT, "Forking %d variants at instruction %llu...\n\n", n,
+          (unsigned long long)ctx->INSTRUCTION_COUNT);
+  fflush(NULL);			/* or each child would repeat pending output */
+  max = cores > 0 ? cores : 1;
+  for (first = 0; first < n; first += max) {
+    for (i = first; i < n && i < first + max; i++) {
+      v[i].pid = -1;
+      if (pipe(fds) < 0)
+        continue;
+      if ((v[i].pid = fork()) == 0) {
+        close(fds[0]);
+        fork_child(ctx, &v[i], fds[1]);
+      }
+      close(fds[1]);
+      v[i].fd = fds[0];
+      if (v[i].pid < 0)
+        close(fds[0]);
+    }
+    for (i = first; i < n && i < first + max; i++) {
+      if (v[i].pid > 0)
+        fork_collect(&v[i]);
+      else
+        v[i].result.status = 1;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    static const char *outcome[] = { "halted", "failed", "budget exhausted", "still running" };
+
+    fprintf(ctx->OUT, "Variant %d [%s]: %s\n", i, v[i].spec, outcome[v[i].result.status & 3]);
+    if (v[i].dump != NULL)
+      fputs(v[i].dump, ctx->OUT);
+    else
+      fprintf(ctx->OUT, "\n");
+  }
+
+  /* registers that differ between variants, one column each */
+  fprintf(ctx->OUT, "Differences :\n");
+  fprintf(ctx->OUT, "-------------------------------------\n");
+  fprintf(ctx->OUT, "        ");
+  for (i = 0; i < n; i++)
+    fprintf(ctx->OUT, " %10d", i);
+  fprintf(ctx->OUT, "\n");
+  for (k = 0; k <= ARM_REGS + 1; k++) {
+    uint64_t value[n];
+    int differ = 0;
+
+    for (i = 0; i < n; i++) {
+      value[i] = k < ARM_REGS ? v[i].result.state.REGS[k] :
+                 k == ARM_REGS ? v[i].result.state.CPSR : v[i].result.instruction_count;
+      differ |= value[i] != value[0];
+    }
+    if (!differ)
+      continue;
+    if (k < ARM_REGS)
+      fprintf(ctx->OUT, k == 15 ? "PC      " : "R%-7d", k);
+    else
+      fprintf(ctx->OUT, k == ARM_REGS ? "CPSR    " : "Count   ");
+    for (i = 0; i < n; i++)
+      fprintf(ctx->OUT, k <= ARM_REGS ? " 0x%08llx" : " %10llu", (unsigned long long)value[i]);
+    fprintf(ctx->OUT, "\n");
+  }
+  fprintf(ctx->OUT, "\n");
+
+  for (i = 0; i < n; i++)
+    free(v[i].dump);
+  free(v);
+  free(text);
+  return 0;
+}
@@ -9,14 +9,10 @@
 
 #ifndef _SIM_ISA_H_
 #define _SIM_ISA_H_
-#define N_CUR ( (CURRENT_STATE.CPSR>>31) & 0x00000001 )
-#define Z_CUR ( (CURRENT_STATE.CPSR>>30) & 0x00000001 )
-#define C_CUR ( (CURRENT_STATE.CPSR>>29) & 0x00000001 )
-#define V_CUR ( (CURRENT_STATE.CPSR>>28) & 0x00000001 )
-#define N_NXT ( (NEXT_STATE.CPSR>>31) & 0x00000001 )
-#define Z_NXT ( (NEXT_STATE.CPSR>>30) & 0x00000001 )
-#define C_NXT ( (NEXT_STATE.CPSR>>29) & 0x00000001 )
-#define V_NXT ( (NEXT_STATE.CPSR>>28) & 0x00000001 )
+#define N_CUR(ctx) ( (flags_nzcv(ctx)>>3) & 0x00000001 )
+#define Z_CUR(ctx) ( (flags_nzcv(ctx)>>2) & 0x00000001 )
+#define C_CUR(ctx) ( (flags_nzcv(ctx)>>1) & 0x00000001 )
+#define V_CUR(ctx) ( flags_nzcv(ctx) & 0x00000001 )
 
 
 #define N_N 0x80000000 // Negative
@@ -28,6 +24,110 @@
 #include <stdlib.h>
 #include <string.h>
 #include "shell.h"
+#include "decode.h"
+#include "cache.h"
+#include "btrace.h"
+
+/*
+    Lazy condition flags.  Flag-setting instructions only record what
+    they did; N, Z, C and V are worked out from the record when
+    something reads them (ADC/SBC, a dump, a conditional instruction).
+
+    FLAGS_CPSR  - the flags are the ones already in CURRENT_STATE.CPSR
+    FLAGS_LOGIC - N, Z from result, C is carry (C_KEEP leaves C as is)
+    FLAGS_ARITH - result = a + b + carry; subtraction is recorded as
+                  a + ~b + 1 so C and V come out of the same add
+
+    V always comes from a, b and vres so a logical operation can leave
+    the V of the add before it alone just by not touching them.  The
+    record itself is the lazy_flags in the sim_context (shell.h).
+*/
+#define FLAGS_CPSR  0
+#define FLAGS_LOGIC 1
+#define FLAGS_ARITH 2
+
+#define C_KEEP 2
+
+static inline uint32_t flags_nzcv (sim_context *ctx) {
+
+  uint32_t r = ctx->FLAGS.result;
+  uint32_t c, v;
+
+  if (ctx->FLAGS.kind == FLAGS_CPSR)
+    return ctx->CURRENT_STATE.CPSR >> 28;
+  if (ctx->FLAGS.kind == FLAGS_ARITH)
+    c = ((uint64_t)ctx->FLAGS.a + ctx->FLAGS.b + ctx->FLAGS.carry) >> 32;
+  else
+    c = ctx->FLAGS.carry;
+  v = ((ctx->FLAGS.a ^ ctx->FLAGS.vres) & (ctx->FLAGS.b ^ ctx->FLAGS.vres)) >> 31;
+  return (r >> 31) << 3 | (r == 0) << 2 | c << 1 | v;
+}
+
+static inline void flags_arith (sim_context *ctx, uint32_t a, uint32_t b, uint32_t carry,
+                                uint32_t result) {
+  ctx->FLAGS.kind = FLAGS_ARITH;
+  ctx->FLAGS.result = result;
+  ctx->FLAGS.carry = carry;
+  ctx->FLAGS.a = a;
+  ctx->FLAGS.b = b;
+  ctx->FLAGS.vres = result;
+}
+
+static inline void flags_logic (sim_context *ctx, uint32_t result, uint32_t carry) {
+  if (carry == C_KEEP)
+    carry = (flags_nzcv(ctx) >> 1) & 1;
+  if (ctx->FLAGS.kind == FLAGS_CPSR) {
+    /* (V ^ 0) & (V ^ 0) keeps the old V */
+    ctx->FLAGS.a = ctx->FLAGS.b = (ctx->CURRENT_STATE.CPSR & V_N) << 3;
+    ctx->FLAGS.vres = 0;
+  }
+  ctx->FLAGS.kind = FLAGS_LOGIC;
+  ctx->FLAGS.result = result;
+  ctx->FLAGS.carry = carry;
+}
+
+/*
+    Condition field (31:28) lookup: bit NZCV of COND_TABLE[cond] is set
+    when the condition holds for those flags, so checking a condition
+    is one load and a bit test.  AL skips the flag evaluation.
+*/
+static const uint16_t COND_TABLE[16] = {
+  0xf0f0, /* EQ  Z set */
+  0x0f0f, /* NE  Z clear */
+  0xcccc, /* CS  C set */
+  0x3333, /* CC  C clear */
+  0xff00, /* MI  N set */
+  0x00ff, /* PL  N clear */
+  0xaaaa, /* VS  V set */
+  0x5555, /* VC  V clear */
+  0x0c0c, /* HI  C set and Z clear */
+  0xf3f3, /* LS  C clear or Z set */
+  0xaa55, /* GE  N == V */
+  0x55aa, /* LT  N != V */
+  0x0a05, /* GT  Z clear and N == V */
+  0xf5fa, /* LE  Z set or N != V */
+  0xffff, /* AL  always */
+  0x0000  /* NV  never */
+};
+
+static inline int cond_passed (sim_context *ctx, uint32_t cond) {
+  return cond == COND_AL || ((COND_TABLE[cond] >> flags_nzcv(ctx)) & 1);
+}
+
+/*
+    Write the pending flags into CPSR.  Called before anything outside
+    the handlers looks at CPSR.
+*/
+void flags_sync (sim_context *ctx) {
+
+  uint32_t nzcv = flags_nzcv(ctx) << 28;
+
+  ctx->CURRENT_STATE.CPSR = (ctx->CURRENT_STATE.CPSR & 0x0FFFFFFF) | nzcv;
+#ifdef SIM_DOUBLE_BUFFER
+  ctx->NEXT_STATE.CPSR = ctx->CURRENT_STATE.CPSR;
+#endif
+  ctx->FLAGS.kind = FLAGS_CPSR;
+}
 
 /*
     Rd - Destination Register
@@ -50,1540 +150,329 @@
             Src2 contains shamt5, sh, and Rm
               11:7 - shamt5, this is the amount Rm is shifted
               6:5 - sh, this is the type of shift for Rm (i.e. <<, >>, >>>, ROR)
-              4 - this bit is always 0
+              4 - 0 to shift by shamt5, 1 to shift by Rs (11:8)
               3:0 - Rm, the second source operand
+            or, when I = 1, a rotate (11:8) and an 8-bit immediate (7:0)
 
 */
 
-int ADD (int Rd, int Rn, int Operand2, int I, int S, int CC) {
+/*
+    Barrel shifter.  Returns operand 2 and sets *carry to the shifter
+    carry-out, or to C_KEEP when the operand went through unshifted
+    and C is left as it was.
+
+    I = 1                - 8-bit immediate rotated right by 2 * 11:8
+    I = 0, bit 4 = 0     - Rm shifted by shamt5; LSR #0 and ASR #0
+                           mean #32 and ROR #0 is RRX
+    I = 0, bit 4 = 1     - Rm shifted by the bottom byte of Rs
+*/
+static inline uint32_t shifter_operand (sim_context *ctx, int Operand2, int I, uint32_t *carry) {
 
-  int cur = 0;
+  uint32_t Rm, amount;
+  int sh = (Operand2 >> 5) & 0x3;
 
-  //If I = 0 then the processor has to go get Operand2 from memory
-  if(I == 0) {
-    /*
-      These integers apply a mask to different parts of the operand in order to
-      look at specific values
-    */
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
+  if (I == 1) {
+    uint32_t rotate = (Operand2 >> 7) & 0x1E;
+    uint32_t imm = Operand2 & 0xFF;
+    if (rotate == 0) {
+      *carry = C_KEEP;
+      return imm;
+    }
+    imm = (imm >> rotate) | (imm << (32 - rotate));
+    *carry = imm >> 31;
+    return imm;
+  }
 
-    /*This IF checks bit 4 is 1 or 0
-        1 means that this is a Register
-        0 means that this is a Register-shifted Register
-    */
-    if (bit4 == 0){
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] +
-  	     (CURRENT_STATE.REGS[Rm] << shamt5);
-  	    break;
-        case 1: cur = CURRENT_STATE.REGS[Rn] +
-  	     (CURRENT_STATE.REGS[Rm] >> shamt5);
-  	    break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                cur = CURRENT_STATE.REGS[Rn] + cur;
-    	  break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] +
-	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-	      break;
+  Rm = ctx->CURRENT_STATE.REGS[Operand2 & 0xF];
+  if (Operand2 & 0x10) {
+    amount = ctx->CURRENT_STATE.REGS[(Operand2 >> 8) & 0xF] & 0xFF;
+    if (amount == 0) {
+      *carry = C_KEEP;
+      return Rm;
+    }
+  }
+  else {
+    amount = (Operand2 >> 7) & 0x1F;
+    if (amount == 0) {
+      if (sh == 0) {
+        *carry = C_KEEP;
+        return Rm;
       }
-    }else{
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] +
-  	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-  	      break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] +
-  	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-  	      break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                  else{
-                    for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-                  cur = CURRENT_STATE.REGS[Rn] + cur;
-  	      break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] +
-  	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-  	      break;
-        }
+      if (sh == 3) {
+        *carry = Rm & 1;
+        return (C_CUR(ctx) << 31) | (Rm >> 1);
       }
+      amount = 32;
     }
-
-
-  /*
-    If I = 1 then the number being added is there in the command and there
-    is no reason to go to memory again
-  */
-  if (I == 1) {
-    int rotate = Operand2 >> 8;
-    int Imm = Operand2 & 0x000000FF;
-    cur = CURRENT_STATE.REGS[Rn] + (Imm>>2*rotate|(Imm<<(32-2*rotate)));
   }
-  NEXT_STATE.REGS[Rd] = cur;
-
-  /*
-    If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xffffffff){
-      NEXT_STATE.CPSR |= V_N;
-      NEXT_STATE.CPSR |= C_N;
 
+  switch (sh) {
+  case 0: // LSL
+    if (amount < 32) {
+      *carry = (Rm >> (32 - amount)) & 1;
+      return Rm << amount;
     }
+    *carry = amount == 32 ? Rm & 1 : 0;
+    return 0;
+  case 1: // LSR
+    if (amount < 32) {
+      *carry = (Rm >> (amount - 1)) & 1;
+      return Rm >> amount;
+    }
+    *carry = amount == 32 ? Rm >> 31 : 0;
+    return 0;
+  case 2: // ASR
+    if (amount < 32) {
+      *carry = (Rm >> (amount - 1)) & 1;
+      return (int32_t)Rm >> amount;
+    }
+    *carry = Rm >> 31;
+    return (int32_t)Rm >> 31;
+  default: // ROR, a multiple of 32 leaves Rm alone but sets C from bit 31
+    amount &= 31;
+    if (amount == 0) {
+      *carry = Rm >> 31;
+      return Rm;
+    }
+    *carry = (Rm >> (amount - 1)) & 1;
+    return (Rm >> amount) | (Rm << (32 - amount));
   }
-  return 0;
-} //DONE
-int ADC (int Rd, int Rn, int Operand2, int I, int S, int CC) {
-
-  int cur = 0;
-
-  //If I = 0 then the processor has to go get Operand2 from memory
-  if(I == 0) {
-    /*
-      These integers apply a mask to different parts of the operand in order to
-      look at specific values
-    */
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
+}
 
-    /*This IF checks bit 4 is 1 or 0
-        1 means that this is a Register
-        0 means that this is a Register-shifted Register
-    */
-    if (bit4 == 0)
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] +
-  	     (CURRENT_STATE.REGS[Rm] << shamt5) + C_CUR;
-  	    break;
-        case 1: cur =  CURRENT_STATE.REGS[Rn] +
-  	     (CURRENT_STATE.REGS[Rm] >> shamt5) + C_CUR;
-  	    break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rn] +
-                    CURRENT_STATE.REGS[Rm] >> shamt5 + C_CUR;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                    cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  cur = cur + CURRENT_STATE.REGS[Rn] + C_CUR;
-                }
-    	  break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] +
-	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5))) + C_CUR;
-	      break;
-      }else
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] +
-  	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]) + C_CUR;
-  	      break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] +
-  	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) + C_CUR;
-  	      break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                  else{
-                    for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                      cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    cur = cur + CURRENT_STATE.REGS[Rn] + C_CUR;
-                  }
-  	      break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] +
-  	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])))
-                  + C_CUR ;
-  	      break;
-        }
-  }
+/* LSL, LSR, ASR and ROR are MOV with a shifted register operand */
+int MOV (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S);
 
-  /*
-    If I = 1 then the number being added is there in the command and there
-    is no reason to go to memory again
-  */
-  if (I == 1) {
+int ADD (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S) {
 
-    int rotate = Operand2 >> 8;
-    int Imm = Operand2 & 0x000000FF;
-    cur = CURRENT_STATE.REGS[Rn] + (Imm>>2*rotate|(Imm<<(32-2*rotate))) + C_CUR;
-  }
-  NEXT_STATE.REGS[Rd] = cur;
+  uint32_t carry;
+  uint32_t op1 = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t op2 = shifter_operand(ctx, Operand2, I, &carry);
+  uint32_t cur = op1 + op2;
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-  /*
-    If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xFFFFFFFF)
-      NEXT_STATE.CPSR |= V_N;
-      NEXT_STATE.CPSR |= C_N;
-  }
+  if (S == 1)
+    flags_arith(ctx, op1, op2, 0, cur);
   return 0;
-
 } //DONE
+int ADC (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S) {
 
+  uint32_t carry;
+  uint32_t op1 = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t op2 = shifter_operand(ctx, Operand2, I, &carry);
+  uint32_t c = C_CUR(ctx);
+  uint32_t cur = op1 + op2 + c;
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-int AND (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-    int cur = 0;
-
-    //If I = 0 then the processor has to go get Operand2 from memory
-    if(I == 0) {
-      /*
-        These integers apply a mask to different parts of the operand in order to
-        look at specific values
-      */
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
-
-      /*This IF checks bit 4 is 1 or 0
-          1 means that this is a Register
-          0 means that this is a Register-shifted Register
-      */
-      if (bit4 == 0)
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] &
-    	     (CURRENT_STATE.REGS[Rm] << shamt5);
-    	    break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] &
-    	     (CURRENT_STATE.REGS[Rm] >> shamt5);
-    	    break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = (CURRENT_STATE.REGS[Rm] >> shamt5) & CURRENT_STATE.REGS[Rn];
-                  else{
-                    for(int i = 0; i < shamt5; i++)
-                      cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    cur = cur & CURRENT_STATE.REGS[Rn];
-                  }
-      	  break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] &
-  	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-  	      break;
-        }else
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: cur = CURRENT_STATE.REGS[Rn] &
-    	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-    	      break;
-            case 1: cur = CURRENT_STATE.REGS[Rn] &
-    	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-    	      break;
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                    else{
-                      for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                      cur = cur & CURRENT_STATE.REGS[Rn];
-                    }
-    	      break;
-            case 3: cur = CURRENT_STATE.REGS[Rn] &
-    	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-    	      break;
-          }
-
-    /*
-      If I = 1 then the number being added is there in the command and there
-      is no reason to go to memory again
-    */
-    if (I == 1) {
+  if (S == 1)
+    flags_arith(ctx, op1, op2, c, cur);
+  return 0;
+} //DONE
+int AND (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-      int rotate = Operand2 >> 8;
-      int Imm = Operand2 & 0x000000FF;
-      cur = CURRENT_STATE.REGS[Rn] & (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-    }
-    NEXT_STATE.REGS[Rd] = cur;
+  uint32_t carry;
+  uint32_t cur = ctx->CURRENT_STATE.REGS[Rn] & shifter_operand(ctx, Operand2, I, &carry);
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-    /*
-      If S = 1 then set the condition flags
-    */
-    if (S == 1) {
-      if (cur < 0)
-        NEXT_STATE.CPSR |= N_N;
-      if (cur == 0)
-        NEXT_STATE.CPSR |= Z_N;
-      if(cur > 0xffffffff)
-        NEXT_STATE.CPSR |= C_N;
-    }
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
   return 0;
 } //DONE
-int ASR (int Rd, int Rn, int Operand2, int I, int S){
-  int cur = 0;
+int ASR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
+  return MOV(ctx, Rd, Rn, Operand2, I, S);
+} //DONE
+int BIC (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-  //If I = 0 then the processor has to go get Operand2 from memory
-  if(I == 0) {
-    /*
-      These integers apply a mask to different parts of the operand in order to
-      look at specific values
-    */
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
+  uint32_t carry;
+  uint32_t cur = ctx->CURRENT_STATE.REGS[Rn] & ~shifter_operand(ctx, Operand2, I, &carry);
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-    /*This IF checks bit 4 is 1 or 0
-        1 means that this is a Register
-        0 means that this is a Register-shifted Register
-    */
-    if (bit4 == 0)
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rm] << shamt5;
-        break;
-        case 1: cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-        break;
-        case 3: cur = ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-        break;
-      }else
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs];
-          break;
-          case 1: cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-          break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                  else{
-                    for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-          break;
-          case 3: cur = (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs]));
-          break;
-        }
-  }
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
+  return 0;
+} //DONE
+int CMN (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S) {
 
-  NEXT_STATE.REGS[Rd] = cur;
+  uint32_t carry;
+  uint32_t op1 = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t op2 = shifter_operand(ctx, Operand2, I, &carry);
+  uint32_t cur = op1 + op2;
 
-  /*
-  If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-  if (cur < 0)
-    NEXT_STATE.CPSR |= N_N;
-  if (cur == 0)
-    NEXT_STATE.CPSR |= Z_N;
-  if(cur > 0xffffffff)
-    NEXT_STATE.CPSR |= C_N;
-  }
+  if (S == 1)
+    flags_arith(ctx, op1, op2, 0, cur);
   return 0;
+} //DONE
+int CMP (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S) {
 
+  uint32_t carry;
+  uint32_t op1 = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t op2 = shifter_operand(ctx, Operand2, I, &carry);
+  uint32_t cur = op1 - op2;
 
-}
-int BIC (int Rd, int Rn, int Operand2, int S){
-
-    int cur = 0;
+  if (S == 1)
+    flags_arith(ctx, op1, ~op2, 1, cur);
+  return 0;
+} //DONE
+int EOR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-    //If I = 0 then the processor has to go get Operand2 from memory
-    if(I == 0) {
-      /*
-        These integers apply a mask to different parts of the operand in order to
-        look at specific values
-      */
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
+  uint32_t carry;
+  uint32_t cur = ctx->CURRENT_STATE.REGS[Rn] ^ shifter_operand(ctx, Operand2, I, &carry);
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-      /*This IF checks bit 4 is 1 or 0
-          1 means that this is a Register
-          0 means that this is a Register-shifted Register
-      */
-      if (bit4 == 0)
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] &
-           ~(CURRENT_STATE.REGS[Rm] << shamt5);
-          break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] &
-           (CURRENT_STATE.REGS[Rm] >> shamt5);
-          break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                  else{
-                    for(int i = 0; i < shamt5; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-                  cur = CURRENT_STATE.REGS[Rn] & ~cur;
-          break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] &
-                  ~((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-          break;
-      }else{
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: cur = CURRENT_STATE.REGS[Rn] &
-             ~(CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-            break;
-            case 1: cur = CURRENT_STATE.REGS[Rn] &
-             ~(CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-            break;
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                    else{
-                      for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                            cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    }
-                    cur = CURRENT_STATE.REGS[Rn] & ~cur;
-            break;
-            case 3: cur = CURRENT_STATE.REGS[Rn] &
-             ~((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-            break;
-          }
-    }
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
+  return 0;
+} //DONE
+/*
+  Single data transfer addressing.  I = 0 means Operand2 is a 12-bit
+  immediate offset, I = 1 means it is Rm shifted by shamt5 (note this
+  is the opposite sense of I from data processing).  U = 1 adds the
+  offset and U = 0 subtracts it; P = 1 uses the offset address for the
+  access, P = 0 the base.  Post-indexed (P = 0) and W = 1 accesses
+  write the offset address back to Rn.  Returns the access address.
+*/
+uint32_t transfer_address (sim_context *ctx, int Rn, int Operand2, int I, int P, int U, int W){
+  uint32_t base = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t offset = Operand2;
+  uint32_t carry;
+
+  // a register offset is encoded like a data processing Rm, shamt5
+  if (I == 1)
+    offset = shifter_operand(ctx, Operand2, 0, &carry);
+
+  uint32_t moved = U ? base + offset : base - offset;
+  if (P == 0 || W == 1)
+    ctx->ARCH_STATE.REGS[Rn] = moved;
+  return P ? moved : base;
 }
-    /*
-      If I = 1 then the number being added is there in the command and there
-      is no reason to go to memory again
-    */
-    if (I == 1) {
-      int rotate = Operand2 >> 8;
-      int Imm = Operand2 & 0x000000FF;
-      cur = CURRENT_STATE.REGS[Rn] & ~(Imm>>2*rotate|(Imm<<(32-2*rotate)));
-    }
-    NEXT_STATE.REGS[Rd] = cur;
-
-  /*
-    If S = 1 then set the condition flags
-  */
-  if(S == 1){
-    if(cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xffffffff)
-      NEXT_STATE.CPSR |= C_N;
-  }
+int STR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int P, int U, int W){
+  uint32_t data = ctx->CURRENT_STATE.REGS[Rd];
+  uint32_t address = transfer_address(ctx, Rn, Operand2, I, P, U, W);
+  cache_data(ctx, address, 4, 1);
+  btrace_data(ctx, address, 4, 1, data);
+  mem_write_32(ctx, address, data);
   return 0;
 } //DONE
-int CMN (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-    int cur = 0;
-    if(I == 0) {
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
-      if (bit4 == 0)
-        switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] << shamt5);
-  	  break;
-        case 1: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] >> shamt5);
-  	  break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                cur = CURRENT_STATE.REGS[Rn] - cur;
-      	  break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] -
-  	      ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-  	  break;
-        }
-      else
-        switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-  	  break;
-        case 1: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-  	  break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                else{
-                  for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                cur = CURRENT_STATE.REGS[Rn] - cur;
-  	  break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] -
-  	      ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-  	  break;
-        }
-    }
-    if (I == 1) {
-      int rotate = Operand2 >> 8;
-      int Imm = Operand2 & 0x000000FF;
-      cur = CURRENT_STATE.REGS[Rn] - (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-    }
-
-    if (S == 1) {
-      if (cur < 0)
-        NEXT_STATE.CPSR |= N_N;
-      if (cur == 0)
-        NEXT_STATE.CPSR |= Z_N;
-      if(cur > 0xFFFFFFFF){
-        NEXT_STATE.CPSR |= V_N;
-        NEXT_STATE.CPSR |= C_N;
-      }
-    }
-    return 0;
+int LDRB (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int P, int U, int W){
+  uint32_t address = transfer_address(ctx, Rn, Operand2, I, P, U, W);
+  cache_data(ctx, address, 1, 0);
+  ctx->ARCH_STATE.REGS[Rd] = mem_read_8(ctx, address);
+  btrace_data(ctx, address, 1, 0, ctx->ARCH_STATE.REGS[Rd]);
+  return 0;
 } //DONE
-int CMP (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-    int cur = 0;
-
-    //If I = 0 then the processor has to go get Operand2 from memory
-    if(I == 0) {
-      /*
-        These integers apply a mask to different parts of the operand in order to
-        look at specific values
-      */
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
-
-      /*This IF checks bit 4 is 1 or 0
-          1 means that this is a Register
-          0 means that this is a Register-shifted Register
-      */
-      if (bit4 == 0)
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] +
-    	     (CURRENT_STATE.REGS[Rm] << shamt5);
-    	    break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] +
-    	     (CURRENT_STATE.REGS[Rm] >> shamt5);
-    	    break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                  else{
-                    for(int i = 0; i < shamt5; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-                  cur = CURRENT_STATE.REGS[Rn] + cur;
-      	  break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] +
-  	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-  	      break;
-        }else
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: cur = CURRENT_STATE.REGS[Rn] +
-    	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-    	      break;
-            case 1: cur = CURRENT_STATE.REGS[Rn] +
-    	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-    	      break;
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                    else{
-                      for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                            cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    }
-                    cur = CURRENT_STATE.REGS[Rn] + cur;
-    	      break;
-            case 3: cur = CURRENT_STATE.REGS[Rn] +
-    	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-    	      break;
-          }
-    }
-
-    /*
-      If I = 1 then the number being added is there in the command and there
-      is no reason to go to memory again
-    */
-    if (I == 1) {
-      int rotate = Operand2 >> 8;
-      int Imm = Operand2 & 0x000000FF;
-      cur = CURRENT_STATE.REGS[Rn] + (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-    }
-
-    /*
-      If S = 1 then set the condition flags
-    */
-    if (S == 1) {
-      if (cur < 0)
-        NEXT_STATE.CPSR |= N_N;
-      if (cur == 0)
-        NEXT_STATE.CPSR |= Z_N;
-      if(cur > 0xffffffff){
-        NEXT_STATE.CPSR |= V_N;
-        NEXT_STATE.CPSR |= C_N;
-
-      }
-    }
-    return 0;} //DONE
-int EOR (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-      int cur = 0;
-      int nand = 0;
-      int or = 0;
-
-      //If I = 0 then the processor has to go get Operand2 from memory
-      if(I == 0) {
-        /*
-          These integers apply a mask to different parts of the operand in order to
-          look at specific values
-        */
-        int sh = (Operand2 & 0x00000060) >> 5;
-        int shamt5 = (Operand2 & 0x00000F80) >> 7;
-        int bit4 = (Operand2 & 0x00000010) >> 4;
-        int Rm = Operand2 & 0x0000000F;
-        int Rs = (Operand2 & 0x00000F00) >> 8;
-
-        /*This IF checks bit 4 is 1 or 0
-            1 means that this is a Register
-            0 means that this is a Register-shifted Register
-        */
-        if (bit4 == 0){
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: nand = !(CURRENT_STATE.REGS[Rn] &
-      	     (CURRENT_STATE.REGS[Rm] << shamt5));
-              or = CURRENT_STATE.REGS[Rn] |
-              (CURRENT_STATE.REGS[Rm] << shamt5);
-              cur = nand & or;
-      	    break;
-            case 1: nand = !(CURRENT_STATE.REGS[Rn] &
-      	     (CURRENT_STATE.REGS[Rm] >> shamt5));
-              or = CURRENT_STATE.REGS[Rn] |
-              (CURRENT_STATE.REGS[Rm] >> shamt5);
-              cur = nand & or;
-      	    break;
-            //Need to finish case 3
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                    else{
-                      for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    }
-                    nand = !(CURRENT_STATE.REGS[Rn]) & cur;
-                    or = CURRENT_STATE.REGS[Rn] | cur;
-                    cur = nand & or;
-        	  break;
-            case 3: cur = CURRENT_STATE.REGS[Rn] &
-    	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-                   nand = !(CURRENT_STATE.REGS[Rn] & ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                         (CURRENT_STATE.REGS[Rm] << (32 - shamt5))));
-                   or = CURRENT_STATE.REGS[Rn] | ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                         (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-                   cur = nand & or;
-    	      break;
-            }
-          }else{
-            //switch determines how Rm will be shifted
-            switch (sh) {
-              case 0: nand = !(CURRENT_STATE.REGS[Rn] &
-      	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]));
-               or = CURRENT_STATE.REGS[Rn] |
-       	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-               cur = nand & or;
-      	      break;
-              case 1: nand = !(CURRENT_STATE.REGS[Rn] &
-      	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]));
-               or = !(CURRENT_STATE.REGS[Rn] |
-       	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]));
-               cur= nand & or;
-      	      break;
-              // Need to finihs cases 2 and 3
-              case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                        cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                      else{
-                        for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                      }
-                      nand = !(CURRENT_STATE.REGS[Rn] & cur);
-                      or = CURRENT_STATE.REGS[Rn] | cur;
-                      cur = nand & or;
-          	  break;
-              case 3: cur = CURRENT_STATE.REGS[Rn] &
-      	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                     (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-                     nand = !(CURRENT_STATE.REGS[Rn] & (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                           (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-                     or = CURRENT_STATE.REGS[Rn] | ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |  (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-                     cur = nand & or;
-      	      break;
-            }
-      }
-
-      /*
-        If I = 1 then the number being added is there in the command and there
-        is no reason to go to memory again
-      */
-      if (I == 1) {
-
-        int rotate = Operand2 >> 8;
-        int Imm = Operand2 & 0x000000FF;
-        nand = !(CURRENT_STATE.REGS[Rn] & (Imm>>2*rotate|(Imm<<(32-2*rotate))));
-        or = CURRENT_STATE.REGS[Rn] | (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-        cur = nand & or;
-      }
-      NEXT_STATE.REGS[Rd] = cur;
+int LSL (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
+  return MOV(ctx, Rd, Rn, Operand2, I, S);
+} //DONE
+int LSR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
+  return MOV(ctx, Rd, Rn, Operand2, I, S);
+} //DONE
+int MOV (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-      /*
-        If S = 1 then set the condition flags
-      */
-      if (S == 1) {
-        if (cur < 0)
-          NEXT_STATE.CPSR |= N_N;
-        if (cur == 0)
-          NEXT_STATE.CPSR |= Z_N;
-        if(cur > 0xffffffff)
-          NEXT_STATE.CPSR |= C_N;
-    }
+  uint32_t carry;
+  uint32_t cur = shifter_operand(ctx, Operand2, I, &carry);
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
   return 0;
-
 } //DONE
-int STR (int Rd, int Rn, int Operand2, int I){
-  int sh = (Operand2 & 0x00000060) >> 5;
-  int shamt5 = (Operand2 & 0x00000F80) >> 7;
-  int bit4 = (Operand2 & 0x00000010) >> 4;
-  int Rm = Operand2 & 0x0000000F;
-  int Rs = (Operand2 & 0x00000F00) >> 8;
-
-  if (I == 0){
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: CURRENT_STATE.REGS[Rd] =
-         (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-        break;
-        case 1: CURRENT_STATE.REGS[Rd] =
-         (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                else{
-                  for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                CURRENT_STATE.REGS[Rd] = cur;
-        break;
-        case 3: CURRENT_STATE.REGS[Rd] =
-         ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-               (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-        break;
-      }
-    }else{
-        CURRENT_STATE.REGS[Rd] = Operand2;
-    }
-
-      return 0;} //DONE
-int LDRB (int Rd, int Rn, int Operand2, int I){
-  int sh = (Operand2 & 0x00000060) >> 5;
-  int shamt5 = (Operand2 & 0x00000F80) >> 7;
-  int bit4 = (Operand2 & 0x00000010) >> 4;
-  int Rm = Operand2 & 0x0000000F;
-  int Rs = (Operand2 & 0x00000F00) >> 8;
-
-  if (I == 0){
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: CURRENT_STATE.REGS[Rd]  = (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs])>> 8;
-        break;
-        case 1:  CURRENT_STATE.REGS[Rd] = (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) >> 8;
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  CURRENT_STATE.REGS[Rd] = (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) >> 8;
-                else{
-                  int cur = 0;
-                  for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  CURRENT_STATE.REGS[Rd] = cur;
-
-                }
-        break;
-        case 3: CURRENT_STATE.REGS[Rd] = ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-               (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs]))) >> 8;
-        break;
-      }
-    }else{
-        CURRENT_STATE.REGS[Rd] = Operand2 >> 8;
-    }
-    return 0;
+int MVN (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
+  uint32_t carry;
+  // Move the NOT of Operand2 into Rd
+  uint32_t cur = ~shifter_operand(ctx, Operand2, I, &carry);
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
+  return 0;
 } //DONE
-int LSL (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-    int cur = 0;
-
-    //If I = 0 then the processor has to go get Operand2 from memory
-    if(I == 0) {
-      /*
-        These integers apply a mask to different parts of the operand in order to
-        look at specific values
-      */
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
-
-      /*This IF checks bit 4 is 1 or 0
-          1 means that this is a Register
-          0 means that this is a Register-shifted Register
-      */
-      if (bit4 == 0)
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rm] << shamt5;
-    	    break;
-          case 1: cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-    	    break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                  else{
-                    for(int i = 0; i < shamt5; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-      	  break;
-          case 3: cur = ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-  	      break;
-        }else
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: cur = CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs];
-    	      break;
-            case 1: cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-    	      break;
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                    else{
-                      for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                            cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    }
-    	      break;
-            case 3: cur = (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs]));
-    	      break;
-          }
-    }
+int ORR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-    NEXT_STATE.REGS[Rd] = cur;
+  uint32_t carry;
+  uint32_t cur = ctx->CURRENT_STATE.REGS[Rn] | shifter_operand(ctx, Operand2, I, &carry);
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-  /*
-    If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xffffffff)
-      NEXT_STATE.CPSR |= C_N;
-  }
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
   return 0;
 } //DONE
-int LSR (int Rd, int Rn, int Operand2, int I, int S, int CC){
-  int cur = 0;
-
-  //If I = 0 then the processor has to go get Operand2 from memory
-  if(I == 0) {
-    /*
-      These integers apply a mask to different parts of the operand in order to
-      look at specific values
-    */
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
-
-    /*This IF checks bit 4 is 1 or 0
-        1 means that this is a Register
-        0 means that this is a Register-shifted Register
-    */
-    if (bit4 == 0)
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rm] << shamt5;
-        break;
-        case 1: cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-        break;
-        case 3: cur = ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-        break;
-      }else
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs];
-          break;
-          case 1: cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-          break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                  else{
-                    for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-          break;
-          case 3: cur = (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs]));
-          break;
-        }
-  }
+int ROR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
+  return MOV(ctx, Rd, Rn, Operand2, I, S);
+} //DONE
+int SBC (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S) {
 
-  NEXT_STATE.REGS[Rd] = cur;
+  uint32_t carry;
+  uint32_t op1 = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t op2 = shifter_operand(ctx, Operand2, I, &carry);
+  uint32_t c = C_CUR(ctx);
+  uint32_t cur = op1 - op2 - !c;
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-  /*
-  If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-  if (cur < 0)
-    NEXT_STATE.CPSR |= N_N;
-  if (cur == 0)
-    NEXT_STATE.CPSR |= Z_N;
-  if(cur > 0xffffffff)
-    NEXT_STATE.CPSR |= C_N;
-  }
+  if (S == 1)
+    flags_arith(ctx, op1, ~op2, c, cur);
   return 0;
-
-}
-int MOV (int Rd, int Operand2, int I, int S){
-  if(I == 1 || ((Operand2 & 0x00000ff0) >> 4) == 0x00) {
-    CURRENT_STATE.REGS[Rd] = Operand2;
-  }
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xffffffff)
-      NEXT_STATE.CPSR |= C_N;
-  }
+} //DONE
+int LDR (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int P, int U, int W){
+  uint32_t address = transfer_address(ctx, Rn, Operand2, I, P, U, W);
+  cache_data(ctx, address, 4, 0);
+  ctx->ARCH_STATE.REGS[Rd] = mem_read_32(ctx, address);
+  btrace_data(ctx, address, 4, 0, ctx->ARCH_STATE.REGS[Rd]);
   return 0;
 } //DONE
-int MVN (int Rd, int Rn, int S){
-  // Move the NOT of Rn into Rd
-  int cur = NEXT_STATE.REGS[Rd] = ~CURRENT_STATE.REGS[Rn];
-
-  /*
-    If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xffffffff){
-      NEXT_STATE.CPSR |= V_N;
-      NEXT_STATE.CPSR |= C_N;
-    }
-  }
+int STRB (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int P, int U, int W){
+  uint8_t data = ctx->CURRENT_STATE.REGS[Rd] & 0xFF;
+  uint32_t address = transfer_address(ctx, Rn, Operand2, I, P, U, W);
+  cache_data(ctx, address, 1, 1);
+  btrace_data(ctx, address, 1, 1, data);
+  mem_write_8(ctx, address, data);
   return 0;
-} // DONE
-int ORR (int Rd, int Rn, int Operand2, int I, int S, int CC){
-    int cur = 0;
-
-    //If I = 0 then the processor has to go get Operand2 from memory
-    if(I == 0) {
-      /*
-        These integers apply a mask to different parts of the operand in order to
-        look at specific values
-      */
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
-
-      /*This IF checks bit 4 is 1 or 0
-          1 means that this is a Register
-          0 means that this is a Register-shifted Register
-      */
-      if (bit4 == 0)
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] |
-    	     (CURRENT_STATE.REGS[Rm] << shamt5);
-    	    break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] |
-    	     (CURRENT_STATE.REGS[Rm] >> shamt5);
-    	    break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                  else{
-                    for(int i = 0; i < shamt5; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-      	  break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] |
-  	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-  	      break;
-        }else
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: cur = CURRENT_STATE.REGS[Rn] |
-    	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-    	      break;
-            case 1: cur = CURRENT_STATE.REGS[Rn] |
-    	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-    	      break;
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                    else{
-                      for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                            cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                    }
-    	      break;
-            case 3: cur = CURRENT_STATE.REGS[Rn] |
-    	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-    	      break;
-          }
-    }
-
-    /*
-      If I = 1 then the number being added is there in the command and there
-      is no reason to go to memory again
-    */
-    if (I == 1) {
-
-      int rotate = Operand2 >> 8;
-      int Imm = Operand2 & 0x000000FF;
-      cur = CURRENT_STATE.REGS[Rn] | (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-    }
-    NEXT_STATE.REGS[Rd] = cur;
-
-    /*
-      If S = 1 then set the condition flags
-    */
-    if (S == 1) {
-      if (cur < 0)
-        NEXT_STATE.CPSR |= N_N;
-      if (cur == 0)
-        NEXT_STATE.CPSR |= Z_N;
-      if(cur > 0xffffffff)
-        NEXT_STATE.CPSR |= C_N;
-    }
-    return 0;} //DONE
-int ROR (int Rd, int Rn, int Operand2, int I, int S, int CC){
-  int cur = 0;
-
-  //If I = 0 then the processor has to go get Operand2 from memory
-  if(I == 0) {
-    /*
-      These integers apply a mask to different parts of the operand in order to
-      look at specific values
-    */
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
-
-    /*This IF checks bit 4 is 1 or 0
-        1 means that this is a Register
-        0 means that this is a Register-shifted Register
-    */
-    if (bit4 == 0)
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rm] << shamt5;
-        break;
-        case 1: cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-        break;
-        case 3: cur = ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-        break;
-      }else
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs];
-          break;
-          case 1: cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-          break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                  else{
-                    for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-          break;
-          case 3: cur = (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs]));
-          break;
-        }
-  }
+} //DONE
+int SUB (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S) {
 
-  NEXT_STATE.REGS[Rd] = cur;
+  uint32_t carry;
+  uint32_t op1 = ctx->CURRENT_STATE.REGS[Rn];
+  uint32_t op2 = shifter_operand(ctx, Operand2, I, &carry);
+  uint32_t cur = op1 - op2;
+  ctx->ARCH_STATE.REGS[Rd] = cur;
 
-  /*
-  If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-  if (cur < 0)
-    NEXT_STATE.CPSR |= N_N;
-  if (cur == 0)
-    NEXT_STATE.CPSR |= Z_N;
-  if(cur > 0xffffffff)
-    NEXT_STATE.CPSR |= C_N;
-  }
+  if (S == 1)
+    flags_arith(ctx, op1, ~op2, 1, cur);
   return 0;
-
-
-}
-int SBC (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-    int cur = 0;
-    if(I == 0) {
-      int sh = (Operand2 & 0x00000060) >> 5;
-      int shamt5 = (Operand2 & 0x00000F80) >> 7;
-      int bit4 = (Operand2 & 0x00000010) >> 4;
-      int Rm = Operand2 & 0x0000000F;
-      int Rs = (Operand2 & 0x00000F00) >> 8;
-      if (bit4 == 0)
-        switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] << shamt5) + C_CUR;
-  	  break;
-        case 1: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] >> shamt5) + C_CUR;
-  	  break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5 + C_CUR;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                cur = CURRENT_STATE.REGS[Rn] - cur + C_CUR;
-      	  break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] -
-  	      ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - shamt5))) + C_CUR;
-  	  break;
-        }
-      else
-        switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]) + C_CUR;
-  	  break;
-        case 1: cur = CURRENT_STATE.REGS[Rn] -
-  	  (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) + C_CUR;
-	     break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                else{
-                  for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                cur = CURRENT_STATE.REGS[Rn] - cur + C_CUR;
-        break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] -
-  	      ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs]))) + C_CUR;
-  	  break;
-        }
-    }
-    if (I == 1) {
-      int rotate = Operand2 >> 8;
-      int Imm = Operand2 & 0x000000FF;
-      cur = CURRENT_STATE.REGS[Rn] - (Imm>>2*rotate|(Imm<<(32-2*rotate)))
-            + C_CUR;
-    }
-    NEXT_STATE.REGS[Rd] = cur;
-
-    if (S == 1) {
-      if (cur < 0)
-        NEXT_STATE.CPSR |= N_N;
-      if (cur == 0)
-        NEXT_STATE.CPSR |= Z_N;
-      if(cur > 0xFFFFFFFF){
-        NEXT_STATE.CPSR |= V_N;
-        NEXT_STATE.CPSR |= C_N;
-      }
-    }
-    return 0;
-
 } //DONE
-int LDR (int Rd, int Rn, int Operand2, int I){
-  int sh = (Operand2 & 0x00000060) >> 5;
-  int shamt5 = (Operand2 & 0x00000F80) >> 7;
-  int bit4 = (Operand2 & 0x00000010) >> 4;
-  int Rm = Operand2 & 0x0000000F;
-  int Rs = (Operand2 & 0x00000F00) >> 8;
-
-  if (I == 0){
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: CURRENT_STATE.REGS[Rd] =
-         (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-        break;
-        case 1: CURRENT_STATE.REGS[Rn] =
-         (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                else{
-                  for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-                CURRENT_STATE.REGS[Rd] = cur;
-        break;
-        case 3: CURRENT_STATE.REGS[Rd] =
-         ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-               (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-        break;
-      }
-    }else{
-        Operand2 = CURRENT_STATE.REGS[Rd];
-    }
-    return 0;
-}
-int STRB (int Rd, int Rn, int Operand2, int I){
-  int sh = (Operand2 & 0x00000060) >> 5;
-  int shamt5 = (Operand2 & 0x00000F80) >> 7;
-  int bit4 = (Operand2 & 0x00000010) >> 4;
-  int Rm = Operand2 & 0x0000000F;
-  int Rs = (Operand2 & 0x00000F00) >> 8;
-
-  if (I == 0){
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: CURRENT_STATE.REGS[Rm << CURRENT_STATE.REGS[Rs]] = CURRENT_STATE.REGS[Rd] >> 8;
-        break;
-        case 1: CURRENT_STATE.REGS[Rm >> CURRENT_STATE.REGS[Rs]] = CURRENT_STATE.REGS[Rd] >> 8;
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  CURRENT_STATE.REGS[Rm >> CURRENT_STATE.REGS[Rs]] = CURRENT_STATE.REGS[Rd] >> 8;
-                else{
-                  int cur = 0;
-                  for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  CURRENT_STATE.REGS[Rd] = cur >> 8;
-
-                }
-        break;
-        case 3: CURRENT_STATE.REGS[Rd] =
-         ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-               (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-        break;
-      }
-    }else{
-        Operand2 = CURRENT_STATE.REGS[Rd] >> 8;
-    }
-    return 0;
-
-
-}
-int SUB (int Rd, int Rn, int Operand2, int I, int S, int CC) {
-
-  int cur = 0;
-  if(I == 0) {
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
-    if (bit4 == 0)
-      switch (sh) {
-      case 0: cur = CURRENT_STATE.REGS[Rn] -
-	  (CURRENT_STATE.REGS[Rm] << shamt5);
-	  break;
-      case 1: cur = CURRENT_STATE.REGS[Rn] -
-	  (CURRENT_STATE.REGS[Rm] >> shamt5);
-	  break;
-      case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-              else{
-                for(int i = 0; i < shamt5; i++)
-                      cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-              }
-              cur = CURRENT_STATE.REGS[Rn] - cur;
-    	  break;
-      case 3: cur = CURRENT_STATE.REGS[Rn] -
-	      ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-	  break;
-      }
-    else
-      switch (sh) {
-      case 0: cur = CURRENT_STATE.REGS[Rn] -
-	  (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-	  break;
-      case 1: cur = CURRENT_STATE.REGS[Rn] -
-	  (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-	  break;
-      case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-              else{
-                for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                      cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-              }
-              cur = CURRENT_STATE.REGS[Rn] - cur;
-	  break;
-      case 3: cur = CURRENT_STATE.REGS[Rn] -
-	      ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-               (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-	  break;
-      }
-  }
-  if (I == 1) {
-    int rotate = Operand2 >> 8;
-    int Imm = Operand2 & 0x000000FF;
-    cur = CURRENT_STATE.REGS[Rn] - (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-  }
-  NEXT_STATE.REGS[Rd] = cur;
+int TEQ (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xFFFFFFFF){
-      NEXT_STATE.CPSR |= V_N;
-      NEXT_STATE.CPSR |= C_N;
-    }
-  }
-  return 0;} //DONE
-int TEQ (int Rd, int Rn, int Operand2, int I, int S, int CC){
-  int cur = 0;
-
-  //If I = 0 then the processor has to go get Operand2 from memory
-  if(I == 0) {
-    /*
-      These integers apply a mask to different parts of the operand in order to
-      look at specific values
-    */
-    int sh = (Operand2 & 0x00000060) >> 5;
-    int shamt5 = (Operand2 & 0x00000F80) >> 7;
-    int bit4 = (Operand2 & 0x00000010) >> 4;
-    int Rm = Operand2 & 0x0000000F;
-    int Rs = (Operand2 & 0x00000F00) >> 8;
-
-    /*This IF checks bit 4 is 1 or 0
-        1 means that this is a Register
-        0 means that this is a Register-shifted Register
-    */
-    if (bit4 == 0)
-      //switch determines how Rm will be shifted
-      switch (sh) {
-        case 0: cur = CURRENT_STATE.REGS[Rn] |
-         (CURRENT_STATE.REGS[Rm] << shamt5);
-        break;
-        case 1: cur = CURRENT_STATE.REGS[Rn] |
-         (CURRENT_STATE.REGS[Rm] >> shamt5);
-        break;
-        case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                  cur = CURRENT_STATE.REGS[Rm] >> shamt5;
-                else{
-                  for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                }
-        break;
-        case 3: cur = CURRENT_STATE.REGS[Rn] |
-         ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-               (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-        break;
-      }else
-        //switch determines how Rm will be shifted
-        switch (sh) {
-          case 0: cur = CURRENT_STATE.REGS[Rn] |
-           (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-          break;
-          case 1: cur = CURRENT_STATE.REGS[Rn] |
-           (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-          break;
-          case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                    cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                  else{
-                    for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                  }
-          break;
-          case 3: cur = CURRENT_STATE.REGS[Rn] |
-           ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                 (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-          break;
-        }
-  }
+  uint32_t carry;
+  uint32_t cur = ctx->CURRENT_STATE.REGS[Rn] ^ shifter_operand(ctx, Operand2, I, &carry);
 
-  /*
-    If I = 1 then the number being added is there in the command and there
-    is no reason to go to memory again
-  */
-  if (I == 1) {
-
-    int rotate = Operand2 >> 8;
-    int Imm = Operand2 & 0x000000FF;
-    cur = CURRENT_STATE.REGS[Rn] | (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-  }
-
-  /*
-    If S = 1 then set the condition flags
-  */
-  if (S == 1) {
-    if (cur < 0)
-      NEXT_STATE.CPSR |= N_N;
-    if (cur == 0)
-      NEXT_STATE.CPSR |= Z_N;
-    if(cur > 0xffffffff)
-      NEXT_STATE.CPSR |= C_N;
-  }
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
   return 0;
 } //DONE
-int TST (int Rd, int Rn, int Operand2, int I, int S, int CC){
-
-      int cur = 0;
+int TST (sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S){
 
-      //If I = 0 then the processor has to go get Operand2 from memory
-      if(I == 0) {
-        /*
-          These integers apply a mask to different parts of the operand in order to
-          look at specific values
-        */
-        int sh = (Operand2 & 0x00000060) >> 5;
-        int shamt5 = (Operand2 & 0x00000F80) >> 7;
-        int bit4 = (Operand2 & 0x00000010) >> 4;
-        int Rm = Operand2 & 0x0000000F;
-        int Rs = (Operand2 & 0x00000F00) >> 8;
+  uint32_t carry;
+  uint32_t cur = ctx->CURRENT_STATE.REGS[Rn] & shifter_operand(ctx, Operand2, I, &carry);
 
-        /*This IF checks bit 4 is 1 or 0
-            1 means that this is a Register
-            0 means that this is a Register-shifted Register
-        */
-        if (bit4 == 0)
-          //switch determines how Rm will be shifted
-          switch (sh) {
-            case 0: cur = CURRENT_STATE.REGS[Rn] &
-      	     (CURRENT_STATE.REGS[Rm] << shamt5);
-      	    break;
-            case 1: cur = CURRENT_STATE.REGS[Rn] &
-      	     (CURRENT_STATE.REGS[Rm] >> shamt5);
-      	    break;
-            case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                      cur = (CURRENT_STATE.REGS[Rm] >> shamt5) & CURRENT_STATE.REGS[Rn];
-                    else{
-                      for(int i = 0; i < shamt5; i++)
-                        cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                      cur = cur & CURRENT_STATE.REGS[Rn];
-                    }
-        	  break;
-            case 3: cur = CURRENT_STATE.REGS[Rn] &
-    	       ((CURRENT_STATE.REGS[Rm] >> shamt5) |
-                   (CURRENT_STATE.REGS[Rm] << (32 - shamt5)));
-    	      break;
-          }else
-            //switch determines how Rm will be shifted
-            switch (sh) {
-              case 0: cur = CURRENT_STATE.REGS[Rn] &
-      	       (CURRENT_STATE.REGS[Rm] << CURRENT_STATE.REGS[Rs]);
-      	      break;
-              case 1: cur = CURRENT_STATE.REGS[Rn] &
-      	       (CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]);
-      	      break;
-              case 2: if(CURRENT_STATE.REGS[Rm] & 0x80000000 == 0)
-                        cur = CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs];
-                      else{
-                        for(int i = 0; i < CURRENT_STATE.REGS[Rs]; i++)
-                          cur = (CURRENT_STATE.REGS[Rm] >> 1) + 0x80000000;
-                        cur = cur & CURRENT_STATE.REGS[Rn];
-                      }
-      	      break;
-              case 3: cur = CURRENT_STATE.REGS[Rn] &
-      	       ((CURRENT_STATE.REGS[Rm] >> CURRENT_STATE.REGS[Rs]) |
-                     (CURRENT_STATE.REGS[Rm] << (32 - CURRENT_STATE.REGS[Rs])));
-      	      break;
-            }
-      }
-
-      /*
-        If I = 1 then the number being added is there in the command and there
-        is no reason to go to memory again
-      */
-      if (I == 1) {
-
-        int rotate = Operand2 >> 8;
-        int Imm = Operand2 & 0x000000FF;
-        cur = CURRENT_STATE.REGS[Rn] & (Imm>>2*rotate|(Imm<<(32-2*rotate)));
-      }
-
-      /*
-        If S = 1 then set the condition flags
-      */
-      if (S == 1) {
-        if (cur < 0)
-          NEXT_STATE.CPSR |= N_N;
-        if (cur == 0)
-          NEXT_STATE.CPSR |= Z_N;
-        if(cur > 0xffffffff)
-          NEXT_STATE.CPSR |= C_N;
-    }
-    return 0;
+  if (S == 1)
+    flags_logic(ctx, cur, carry);
+  return 0;
 } //DONE
-int B (int imm24){
-  CURRENT_STATE.REGS[15] = (CURRENT_STATE.REGS[15] + 8) + imm24 << 2;
+/*
+  R15 reads as the branch address + 8, so the target is PC + imm24 * 4
+  and the return address is the instruction after the branch.
+*/
+int B (sim_context *ctx, int imm24){
+  ctx->ARCH_STATE.REGS[15] = ctx->CURRENT_STATE.REGS[15] + (imm24 << 2);
+  return 0;
 } // DONE
-int BL (int imm24){
-  CURRENT_STATE.REGS[14] = (CURRENT_STATE.REGS[15] + 8) - 4;
-  CURRENT_STATE.REGS[15] = (CURRENT_STATE.REGS[15] + 8) + imm24 << 2;
+int BL (sim_context *ctx, int imm24){
+  ctx->ARCH_STATE.REGS[14] = ctx->CURRENT_STATE.REGS[15] - 4;
+  ctx->ARCH_STATE.REGS[15] = ctx->CURRENT_STATE.REGS[15] + (imm24 << 2);
+  return 0;
 } //DONE
 int MLA (char* i_);
 int MUL (char* i_);
 
-int SWI (char* i_){return 0;}
+int SWI (sim_context *ctx, int imm24){return 0;}
 
 #endif
@@ -0,0 +1,236 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "shell.h"
+#include "cache.h"
+#include "bpred.h"
+#include "timing.h"
+#include "btrace.h"
+
+/*
+   Many programs in one process.  Each job gets a fresh machine from
+   sim_create, so jobs share nothing but the read-only tables; worker
+   threads take the next job number off a shared counter until the
+   list runs out.
+*/
+typedef struct {
+  char *filename;
+  char *out_filename;
+  int status;			/* batch() exit status */
+  uint64_t instructions;
+} job_t;
+
+typedef struct {
+  const sim_context *options;
+  job_t *jobs;
+  int num_jobs;
+  int next;			/* next job to hand out, atomic */
+  char *script_filename, *commands;
+  int trace;			/* write <job>.trace (--trace-file) */
+} job_queue;
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run_job                                         */
+/*                                                             */
+/* Purpose   : Load and run one program on its own machine,    */
+/*             writing everything it prints to the job's .out  */
+/*             file.                                           */
+/*                                                             */
+/***************************************************************/
+static void run_job (job_queue *q, job_t *job) {
+
+  FILE * out;
+  sim_context *ctx;
+
+  if ((out = fopen(job->out_filename, "w")) == NULL) {
+    fprintf(stderr, "Error: Can't open output file %s\n", job->out_filename);
+    job->status = 1;
+    return;
+  }
+
+  if ((ctx = sim_create()) == NULL) {
+    fprintf(out, "Error: Can't allocate simulator memory\n");
+    fclose(out);
+    job->status = 1;
+    return;
+  }
+  ctx->OUT = out;
+  ctx->BLOCK_MODE = q->options->BLOCK_MODE;
+  ctx->TRACE_LEVEL = q->options->TRACE_LEVEL;
+  ctx->INSTRUCTION_BUDGET = q->options->INSTRUCTION_BUDGET;
+  if (q->options->PROFILE != NULL) {
+    char *profile = malloc(strlen(job->out_filename) + 9);
+
+    sprintf(profile, "%.*s.profile", (int)strlen(job->out_filename) - 4, job->out_filename);
+    profile_enable(ctx, profile);
+    free(profile);
+  }
+  if (q->options->CACHES != NULL) {
+    if (q->options->CACHES->icache != NULL)
+      cache_enable(ctx, 0, &q->options->CACHES->icache->config);
+    if (q->options->CACHES->dcache != NULL)
+      cache_enable(ctx, 1, &q->options->CACHES->dcache->config);
+  }
+  if (q->options->BPRED != NULL)
+    bpred_enable(ctx, &q->options->BPRED->config);
+  if (q->options->TIMING != NULL)
+    timing_enable(ctx, &q->options->TIMING->config);
+  if (q->trace) {
+    char *trace = malloc(strlen(job->out_filename) + 7);
+
+    sprintf(trace, "%.*s.trace", (int)strlen(job->out_filename) - 4, job->out_filename);
+    btrace_open(ctx, trace);
+    free(trace);
+  }
+
+  if (initialize(ctx, &job->filename, 1) < 0)
+    job->status = 1;
+  else
+    job->status = batch(ctx, NULL, q->script_filename, q->commands);
+  job->instructions = ctx->INSTRUCTION_COUNT;
+
+  sim_destroy(ctx);
+  fclose(out);
+}
+
+static void *job_worker (void *arg) {
+
+  job_queue *q = arg;
+  int i;
+
+  while ((i = __sync_fetch_and_add(&q->next, 1)) < q->num_jobs)
+    run_job(q, &q->jobs[i]);
+  return NULL;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run_jobs                                        */
+/*                                                             */
+/* Purpose   : Run every program file as a job and print one   */
+/*             line per job, in argument order:                */
+/*                                                             */
+/*   job=<file> status=<0-3> instrs=<n> out=<file>             */
+/*                                                             */
+/*             Returns 1 if any job failed with a bad command  */
+/*             or file, else the highest job status.           */
+/*                                                             */
+/***************************************************************/
+int run_jobs (const sim_context *options, char **program_filenames, int num_prog_files,
+              int nthreads, char *outdir, char *script_filename, char *commands,
+              int trace) {
+
+  job_queue q;
+  pthread_t *threads;
+  int i, worst = 0;
+
+  if (nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > num_prog_files)
+    nthreads = num_prog_files;
+  if (nthreads < 1)
+    nthreads = 1;
+
+  q.options = options;
+  q.jobs = calloc(num_prog_files, sizeof(job_t));
+  q.num_jobs = num_prog_files;
+  q.next = 0;
+  q.script_filename = script_filename;
+  q.commands = commands;
+  q.trace = trace;
+
+  /*
+     <outdir>/<basename>.out, or <basename>.<n>.out for a repeat, n
+     counting up from the job number until no earlier job has the name
+  */
+  for (i = 0; i < num_prog_files; i++) {
+    char *base = strrchr(program_filenames[i], '/');
+    int k, suffix = i;
+
+    base = base ? base + 1 : program_filenames[i];
+    q.jobs[i].filename = program_filenames[i];
+    q.jobs[i].out_filename = malloc(strlen(outdir) + strlen(base) + 20);
+    sprintf(q.jobs[i].out_filename, "%s/%s.out", outdir, base);
+    for (k = 0; k < i; k++)
+      if (!strcmp(q.jobs[k].out_filename, q.jobs[i].out_filename)) {
+        sprintf(q.jobs[i].out_filename, "%s/%s.%d.out", outdir, base, suffix++);
+        k = -1;			/* check the new name against them all */
+      }
+  }
+
+  threads = malloc(nthreads * sizeof(pthread_t));
+  for (i = 0; i < nthreads; i++)
+    if (pthread_create(&threads[i], NULL, job_worker, &q) != 0)
+      break;
+  if (i == 0)
+    job_worker(&q);		/* no threads to be had, run them here */
+  while (i > 0)
+    pthread_join(threads[--i], NULL);
+
+  for (i = 0; i < num_prog_files; i++) {
+    job_t *job = &q.jobs[i];
+
+    printf("job=%s status=%d instrs=%llu out=%s\n", job->filename, job->status,
+           (unsigned long long)job->instructions, job->out_filename);
+    if (job->status == 1 || worst == 1)
+      worst = 1;
+    else if (job->status > worst)
+      worst = job->status;
+    free(job->out_filename);
+  }
+  free(threads);
+  free(q.jobs);
+  return worst;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : read_manifest                                   */
+/*                                                             */
+/* Purpose   : Read program file names, one per line (blank    */
+/*             lines and # comments skipped).  Returns NULL if */
+/*             the manifest can't be opened.                   */
+/*                                                             */
+/***************************************************************/
+char **read_manifest (char *manifest_filename, int *num_prog_files) {
+
+  FILE * manifest;
+  char line[COMMAND_LINE_MAX];
+  char **names = NULL;
+  int count = 0, max = 0;
+
+  if ((manifest = fopen(manifest_filename, "r")) == NULL) {
+    printf("Error: Can't open manifest file %s\n", manifest_filename);
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), manifest) != NULL) {
+    char *name = line + strspn(line, " \t");
+
+    name[strcspn(name, " \t\r\n")] = '\0';
+    if (name[0] == '\0' || name[0] == '#')
+      continue;
+    if (count == max) {
+      max = max ? 2 * max : 64;
+      names = realloc(names, max * sizeof(char *));
+    }
+    names[count++] = strdup(name);
+  }
+  fclose(manifest);
+
+  *num_prog_files = count;
+  return names ? names : malloc(sizeof(char *));
+}
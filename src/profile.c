@@ -0,0 +1,288 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "profile.h"
+
+/* hottest text words listed in the text report (the JSON has all) */
+#define PROFILE_TOP 20
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : profile_enable                                  */
+/*                                                             */
+/* Purpose   : Start counting from zero.  filename, if not     */
+/*             NULL, gets the report (and filename.json) when  */
+/*             the program halts.                              */
+/*                                                             */
+/***************************************************************/
+void profile_enable (sim_context *ctx, char *filename) {
+
+  sim_profile *p;
+
+  profile_free(ctx);
+  p = calloc(1, sizeof(sim_profile));
+  p->pc_executed = calloc(PROFILE_WORDS, sizeof(uint64_t));
+  p->pc_skipped = calloc(PROFILE_WORDS, sizeof(uint64_t));
+  p->filename = filename ? strdup(filename) : NULL;
+  ctx->PROFILE = p;
+}
+
+void profile_free (sim_context *ctx) {
+
+  sim_profile *p = ctx->PROFILE;
+
+  if (p == NULL)
+    return;
+  free(p->pc_executed);
+  free(p->pc_skipped);
+  free(p->filename);
+  free(p);
+  ctx->PROFILE = NULL;
+}
+
+/* a counter and what it counts, for sorting */
+typedef struct {
+  uint64_t count;
+  uint32_t index;
+} profile_entry;
+
+/* most instructions first, then lowest index */
+static int by_count (const void *a, const void *b) {
+
+  const profile_entry *x = a, *y = b;
+
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+   Mnemonics and text words that ran at least once, hottest first.
+   Returns the number of words in *pcs (malloc'd); *num_ops gets the
+   number of mnemonics in ops.
+*/
+static uint32_t profile_sort (const sim_profile *p, profile_entry *ops, int *num_ops,
+                              profile_entry **pcs) {
+
+  uint32_t i, n = 0;
+  int k;
+
+  *num_ops = 0;
+  for (k = 0; k < OP_COUNT; k++)
+    if (p->op_executed[k] + p->op_skipped[k] != 0) {
+      ops[*num_ops].count = p->op_executed[k] + p->op_skipped[k];
+      ops[(*num_ops)++].index = k;
+    }
+  for (i = 0; i < PROFILE_WORDS; i++)
+    if (p->pc_executed[i] + p->pc_skipped[i] != 0)
+      n++;
+  *pcs = malloc((n + 1) * sizeof(profile_entry));
+  for (i = 0, n = 0; i < PROFILE_WORDS; i++)
+    if (p->pc_executed[i] + p->pc_skipped[i] != 0) {
+      (*pcs)[n].count = p->pc_executed[i] + p->pc_skipped[i];
+      (*pcs)[n++].index = i;
+    }
+
+  qsort(ops, *num_ops, sizeof(profile_entry), by_count);
+  qsort(*pcs, n, sizeof(profile_entry), by_count);
+  return n;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : profile_report                                  */
+/*                                                             */
+/* Purpose   : Print the profile in dumpsim style: mnemonics   */
+/*             and the PROFILE_TOP hottest text words, most    */
+/*             executed first.                                 */
+/*                                                             */
+/***************************************************************/
+void profile_report (sim_context *ctx, FILE * out) {
+
+  sim_profile *p = ctx->PROFILE;
+  profile_entry op_order[OP_COUNT], *pc_order;
+  int ops, k;
+  uint32_t n, i;
+  uint64_t total = 0, skipped = 0;
+  char *name;
+
+  n = profile_sort(p, op_order, &ops, &pc_order);
+  for (k = 0; k < OP_COUNT; k++) {
+    total += p->op_executed[k] + p->op_skipped[k];
+    skipped += p->op_skipped[k];
+  }
+
+  fprintf(out, "\nProfile :\n");
+  fprintf(out, "-------------------------------------\n");
+  fprintf(out, "Instructions      : %llu\n", (unsigned long long)total);
+  fprintf(out, "Condition failed  : %llu\n", (unsigned long long)skipped);
+  fprintf(out, "Outside text      : %llu\n", (unsigned long long)p->outside);
+  fprintf(out, "\nOpcode        executed     skipped\n");
+  for (k = 0; k < ops; k++)
+    fprintf(out, "%-8s  %12llu %11llu\n", OP_NAMES[op_order[k].index],
+            (unsigned long long)p->op_executed[op_order[k].index],
+            (unsigned long long)p->op_skipped[op_order[k].index]);
+
+  fprintf(out, "\nPC            executed     skipped  word        symbol\n");
+  for (i = 0; i < n && i < PROFILE_TOP; i++) {
+    uint32_t pc = MEM_TEXT_START + 4 * pc_order[i].index;
+
+    name = symbol_name(ctx, pc);
+    fprintf(out, "0x%08x  %12llu %11llu  0x%08x%s%s\n", pc,
+            (unsigned long long)p->pc_executed[pc_order[i].index],
+            (unsigned long long)p->pc_skipped[pc_order[i].index],
+            mem_read_32(ctx, pc), name[0] ? "  " : "", name);
+    free(name);
+  }
+  if (n > PROFILE_TOP)
+    fprintf(out, "... %u more\n", n - PROFILE_TOP);
+  fprintf(out, "\n");
+  free(pc_order);
+}
+
+/* bytes in the UTF-8 sequence starting at s, 0 if it isn't one */
+static int utf8_length (const unsigned char *s) {
+
+  int n, k;
+
+  if (s[0] >= 0xc2 && s[0] <= 0xdf)
+    n = 2;
+  else if (s[0] >= 0xe0 && s[0] <= 0xef)
+    n = 3;
+  else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+    n = 4;
+  else
+    return 0;
+  for (k = 1; k < n; k++)
+    if ((s[k] & 0xc0) != 0x80)
+      return 0;
+  /* overlong forms, UTF-16 surrogates and past U+10FFFF */
+  if ((s[0] == 0xe0 && s[1] < 0xa0) || (s[0] == 0xed && s[1] > 0x9f) ||
+      (s[0] == 0xf0 && s[1] < 0x90) || (s[0] == 0xf4 && s[1] > 0x8f))
+    return 0;
+  return n;
+}
+
+/*
+   s as a JSON string.  ELF symbol names may hold any byte: bytes that
+   aren't valid UTF-8 go out as \u00XX.
+*/
+static void json_string (FILE * out, const char *text) {
+
+  const unsigned char *s = (const unsigned char *)text;
+  int n;
+
+  fputc('"', out);
+  while (*s != '\0') {
+    if (*s == '"' || *s == '\\')
+      fprintf(out, "\\%c", *s++);
+    else if (*s < 0x20)
+      fprintf(out, "\\u%04x", *s++);
+    else if (*s < 0x80)
+      fputc(*s++, out);
+    else if ((n = utf8_length(s)) != 0) {
+      fwrite(s, 1, n, out);
+      s += n;
+    }
+    else
+      fprintf(out, "\\u%04x", *s++);
+  }
+  fputc('"', out);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : profile_json                                    */
+/*                                                             */
+/* Purpose   : The same profile as JSON, every text word that  */
+/*             ran:                                            */
+/*                                                             */
+/*   {"instructions": n, "outside_text": n,                    */
+/*    "opcodes": [{"op": "ADD", "executed": n,                 */
+/*                 "skipped": n}, ...],                        */
+/*    "pcs": [{"pc": "0x00400000", "symbol": "main",           */
+/*             "executed": n, "skipped": n}, ...]}             */
+/*                                                             */
+/***************************************************************/
+void profile_json (sim_context *ctx, FILE * out) {
+
+  sim_profile *p = ctx->PROFILE;
+  profile_entry op_order[OP_COUNT], *pc_order;
+  int ops, k;
+  uint32_t n, i;
+  uint64_t total = 0;
+  char *name;
+
+  n = profile_sort(p, op_order, &ops, &pc_order);
+  for (k = 0; k < OP_COUNT; k++)
+    total += p->op_executed[k] + p->op_skipped[k];
+
+  fprintf(out, "{\"instructions\": %llu, \"outside_text\": %llu,\n \"opcodes\": [",
+          (unsigned long long)total, (unsigned long long)p->outside);
+  for (k = 0; k < ops; k++)
+    fprintf(out, "%s\n  {\"op\": \"%s\", \"executed\": %llu, \"skipped\": %llu}",
+            k ? "," : "", OP_NAMES[op_order[k].index],
+            (unsigned long long)p->op_executed[op_order[k].index],
+            (unsigned long long)p->op_skipped[op_order[k].index]);
+  fprintf(out, "],\n \"pcs\": [");
+  for (i = 0; i < n; i++) {
+    uint32_t pc = MEM_TEXT_START + 4 * pc_order[i].index;
+
+    name = symbol_name(ctx, pc);
+    fprintf(out, "%s\n  {\"pc\": \"0x%08x\", \"symbol\": ", i ? "," : "", pc);
+    json_string(out, name);
+    free(name);
+    fprintf(out, ", \"executed\": %llu, \"skipped\": %llu}",
+            (unsigned long long)p->pc_executed[pc_order[i].index],
+            (unsigned long long)p->pc_skipped[pc_order[i].index]);
+  }
+  fprintf(out, "]}\n");
+  free(pc_order);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : profile_write                                   */
+/*                                                             */
+/* Purpose   : Write the report to the -p file and the JSON    */
+/*             next to it as <file>.json.                      */
+/*                                                             */
+/***************************************************************/
+void profile_write (sim_context *ctx) {
+
+  sim_profile *p = ctx->PROFILE;
+  char *json_name;
+  FILE * out;
+
+  if (p == NULL || p->filename == NULL)
+    return;
+  if ((out = fopen(p->filename, "w")) == NULL) {
+    fprintf(ctx->OUT, "Error: Can't open profile file %s\n", p->filename);
+    return;
+  }
+  profile_report(ctx, out);
+  fclose(out);
+
+  json_name = malloc(strlen(p->filename) + 6);
+  sprintf(json_name, "%s.json", p->filename);
+  if ((out = fopen(json_name, "w")) == NULL)
+    fprintf(ctx->OUT, "Error: Can't open profile file %s\n", json_name);
+  else {
+    profile_json(ctx, out);
+    fclose(out);
+    fprintf(ctx->OUT, "Profile written to %s and %s\n\n", p->filename, json_name);
+  }
+  free(json_name);
+}
@@ -0,0 +1,50 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_PROFILE_H_
+#define _SIM_PROFILE_H_
+
+#include <stdint.h>
+
+#include "shell.h"
+#include "decode.h"
+
+/*
+   Execution profile (-p), hung off ctx->PROFILE while enabled.  Every
+   counter is a flat array: per mnemonic, and per text word indexed by
+   (PC - MEM_TEXT_START) >> 2, split by whether the condition passed.
+   Instructions outside text only count per mnemonic.
+*/
+#define PROFILE_WORDS (MEM_TEXT_SIZE >> 2)
+
+typedef struct sim_profile {
+  uint64_t op_executed[OP_COUNT];
+  uint64_t op_skipped[OP_COUNT];
+  uint64_t *pc_executed;	/* PROFILE_WORDS each */
+  uint64_t *pc_skipped;
+  uint64_t outside;		/* instructions outside text */
+  char *filename;		/* report written here at halt, NULL for none */
+} sim_profile;
+
+static inline void profile_count (sim_profile *p, const decoded_inst *d,
+                                  uint32_t pc, int passed) {
+
+  uint32_t index = (pc - MEM_TEXT_START) >> 2;
+
+  if (passed)
+    p->op_executed[d->op]++;
+  else
+    p->op_skipped[d->op]++;
+  if (index < PROFILE_WORDS)
+    (passed ? p->pc_executed : p->pc_skipped)[index]++;
+  else
+    p->outside++;
+}
+
+#endif
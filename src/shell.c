@@ -16,32 +16,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
+#include <limits.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "shell.h"
+#include "cache.h"
+#include "bpred.h"
+#include "timing.h"
+#include "btrace.h"
 
 /***************************************************************/
 /* Main memory.                                                */
 /***************************************************************/
 
-#define MEM_DATA_START  0x10000000
-#define MEM_DATA_SIZE   0x00100000
-#define MEM_TEXT_START  0x00400000
-#define MEM_TEXT_SIZE   0x00100000
-#define MEM_STACK_START 0x7ff00000
-#define MEM_STACK_SIZE  0x00100000
-#define MEM_KDATA_START 0x90000000
-#define MEM_KDATA_SIZE  0x00100000
-#define MEM_KTEXT_START 0x80000000
-#define MEM_KTEXT_SIZE  0x00100000
-
-typedef struct {
-  uint32_t start, size;
-  uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
+/* memory will be mapped by sim_create */
+static const mem_region_t MEM_MAP[MEM_NREGIONS] = {
   { MEM_TEXT_START, MEM_TEXT_SIZE, NULL },
   { MEM_DATA_START, MEM_DATA_SIZE, NULL },
   { MEM_STACK_START, MEM_STACK_SIZE, NULL },
@@ -49,15 +44,66 @@ mem_region_t MEM_REGIONS[] = {
   { MEM_KTEXT_START, MEM_KTEXT_SIZE, NULL }
 };
 
-#define MEM_NREGIONS (sizeof(MEM_REGIONS)/sizeof(mem_region_t))
+/*
+   Single level page table over the 32-bit guest space: one host
+   pointer per 4 KiB page, NULL for unmapped pages.  Filled from
+   MEM_REGIONS by init_memory.
+*/
+#define PAGE_SHIFT 12
+#define PAGE_SIZE  (1 << PAGE_SHIFT)
+#define PAGE_MASK  (PAGE_SIZE - 1)
+#define PAGE_COUNT (1 << (32 - PAGE_SHIFT))
+
+/*
+   Guest memory is little endian.  Accesses that fit inside one mapped
+   page are a single host load or store (memcpy so unaligned addresses
+   are fine), byte swapped on big endian hosts.  Anything else - an
+   unmapped page or an access straddling two pages - goes through the
+   byte-at-a-time slow path: unmapped bytes read as zero and ignore
+   writes, and unaligned accesses touch exactly the bytes addressed
+   (no ARMv4 rotation).
+*/
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define GUEST_16(x) __builtin_bswap16(x)
+#define GUEST_32(x) __builtin_bswap32(x)
+#else
+#define GUEST_16(x) (x)
+#define GUEST_32(x) (x)
+#endif
+
+static uint32_t mem_read_slow (sim_context *ctx, uint32_t address, int size) {
+
+  uint32_t value = 0;
+  uint8_t *page;
+  int k;
+
+  for (k = size - 1; k >= 0; k--) {
+    page = ctx->PAGE_TABLE[(address + k) >> PAGE_SHIFT];
+    value = (value << 8) | (page ? page[(address + k) & PAGE_MASK] : 0);
+  }
+  return value;
+}
 
-/***************************************************************/
-/* CPU State info.                                             */
-/***************************************************************/
+static void mem_write_slow (sim_context *ctx, uint32_t address, uint32_t value, int size) {
+
+  uint8_t *page;
+  int k;
+
+  for (k = 0; k < size; k++) {
+    page = ctx->PAGE_TABLE[(address + k) >> PAGE_SHIFT];
+    if (page != NULL)
+      page[(address + k) & PAGE_MASK] = (value >> (8 * k)) & 0xFF;
+  }
+}
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_BIT;	/* run bit */
-int INSTRUCTION_COUNT;
+/* drop any predecoded copy of the words just written */
+#define TEXT_WRITTEN(ctx, address, size)                        \
+  do {                                                          \
+    if ((address) - MEM_TEXT_START < MEM_TEXT_SIZE) {           \
+      predecode_invalidate(ctx, address);                       \
+      predecode_invalidate(ctx, (address) + (size) - 1);        \
+    }                                                           \
+  } while (0)
 
 /***************************************************************/
 /*                                                             */
@@ -66,23 +112,51 @@ int INSTRUCTION_COUNT;
 /* Purpose: Read a 32-bit word from memory                     */
 /*                                                             */
 /***************************************************************/
-uint32_t mem_read_32 (uint32_t address) {
+uint32_t mem_read_32 (sim_context *ctx, uint32_t address) {
 
-  int i;
-  for (i = 0; i < MEM_NREGIONS; i++) {
-    if (address >= MEM_REGIONS[i].start &&
-	address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-      uint32_t offset = address - MEM_REGIONS[i].start;
+  uint8_t *page = ctx->PAGE_TABLE[address >> PAGE_SHIFT];
+  uint32_t offset = address & PAGE_MASK;
+  uint32_t value;
 
-      return
-	(MEM_REGIONS[i].mem[offset+3] << 24) |
-	(MEM_REGIONS[i].mem[offset+2] << 16) |
-	(MEM_REGIONS[i].mem[offset+1] <<  8) |
-	(MEM_REGIONS[i].mem[offset+0] <<  0);
-    }
+  if (page != NULL && offset <= PAGE_SIZE - 4) {
+    memcpy(&value, page + offset, 4);
+    return GUEST_32(value);
   }
+  return mem_read_slow(ctx, address, 4);
+}
 
-  return 0;
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_read_16                                      */
+/*                                                             */
+/* Purpose: Read a 16-bit halfword from memory                 */
+/*                                                             */
+/***************************************************************/
+uint16_t mem_read_16 (sim_context *ctx, uint32_t address) {
+
+  uint8_t *page = ctx->PAGE_TABLE[address >> PAGE_SHIFT];
+  uint32_t offset = address & PAGE_MASK;
+  uint16_t value;
+
+  if (page != NULL && offset <= PAGE_SIZE - 2) {
+    memcpy(&value, page + offset, 2);
+    return GUEST_16(value);
+  }
+  return mem_read_slow(ctx, address, 2);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_read_8                                       */
+/*                                                             */
+/* Purpose: Read a byte from memory                            */
+/*                                                             */
+/***************************************************************/
+uint8_t mem_read_8 (sim_context *ctx, uint32_t address) {
+
+  uint8_t *page = ctx->PAGE_TABLE[address >> PAGE_SHIFT];
+
+  return page ? page[address & PAGE_MASK] : 0;
 }
 
 /***************************************************************/
@@ -92,21 +166,58 @@ uint32_t mem_read_32 (uint32_t address) {
 /* Purpose: Write a 32-bit word to memory                      */
 /*                                                             */
 /***************************************************************/
-void mem_write_32 (uint32_t address, uint32_t value) {
+void mem_write_32 (sim_context *ctx, uint32_t address, uint32_t value) {
 
-  int i;
-  for (i = 0; i < MEM_NREGIONS; i++) {
-    if (address >= MEM_REGIONS[i].start &&
-	address < (MEM_REGIONS[i].start + MEM_REGIONS[i].size)) {
-      uint32_t offset = address - MEM_REGIONS[i].start;
+  uint8_t *page = ctx->PAGE_TABLE[address >> PAGE_SHIFT];
+  uint32_t offset = address & PAGE_MASK;
 
-      MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-      MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-      MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-      MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
-      return;
-    }
+  if (page != NULL && offset <= PAGE_SIZE - 4) {
+    value = GUEST_32(value);
+    memcpy(page + offset, &value, 4);
   }
+  else
+    mem_write_slow(ctx, address, value, 4);
+
+  TEXT_WRITTEN(ctx, address, 4);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_write_16                                     */
+/*                                                             */
+/* Purpose: Write a 16-bit halfword to memory                  */
+/*                                                             */
+/***************************************************************/
+void mem_write_16 (sim_context *ctx, uint32_t address, uint16_t value) {
+
+  uint8_t *page = ctx->PAGE_TABLE[address >> PAGE_SHIFT];
+  uint32_t offset = address & PAGE_MASK;
+
+  if (page != NULL && offset <= PAGE_SIZE - 2) {
+    value = GUEST_16(value);
+    memcpy(page + offset, &value, 2);
+  }
+  else
+    mem_write_slow(ctx, address, value, 2);
+
+  TEXT_WRITTEN(ctx, address, 2);
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure: mem_write_8                                      */
+/*                                                             */
+/* Purpose: Write a byte to memory                             */
+/*                                                             */
+/***************************************************************/
+void mem_write_8 (sim_context *ctx, uint32_t address, uint8_t value) {
+
+  uint8_t *page = ctx->PAGE_TABLE[address >> PAGE_SHIFT];
+
+  if (page != NULL)
+    page[address & PAGE_MASK] = value;
+
+  TEXT_WRITTEN(ctx, address, 1);
 }
 
 /***************************************************************/
@@ -116,16 +227,42 @@ void mem_write_32 (uint32_t address, uint32_t value) {
 /* Purpose   : Print out a list of commands                    */
 /*                                                             */
 /***************************************************************/
-void help () {                                                    
+void help (FILE * out) {
+
+  fprintf(out, "----------------ARMv4 ISIM Help-----------------------\n");
+  fprintf(out, "go                    - run program to completion     \n");
+  fprintf(out, "run n                 - execute program for n instrs  \n");
+  fprintf(out, "mdump low high        - dump memory from low to high  \n");
+  fprintf(out, "rdump                 - dump the register & bus value \n");
+  fprintf(out, "input reg_num reg_val - set GPR reg_num to reg_val    \n");
+  fprintf(out, "checkpoint file       - save the machine to a file    \n");
+  fprintf(out, "restore file          - load a saved machine          \n");
+  fprintf(out, "fork-run r1=5,r2=7 .. - go once per register variant  \n");
+  fprintf(out, "profile               - print the -p execution profile\n");
+  fprintf(out, "cache                 - print the cache model counts  \n");
+  fprintf(out, "bpred                 - print the branch predictor    \n");
+  fprintf(out, "timing                - print the pipeline cycle count\n");
+  fprintf(out, "trace level           - none, instr, decode or full   \n");
+  fprintf(out, "# text                - comment, ignored              \n");
+  fprintf(out, "?                     - display this help menu        \n");
+  fprintf(out, "quit                  - exit the program              \n\n");
+}
 
-  printf("----------------ARMv4 ISIM Help-----------------------\n");
-  printf("go                    - run program to completion     \n");
-  printf("run n                 - execute program for n instrs  \n");
-  printf("mdump low high        - dump memory from low to high  \n");
-  printf("rdump                 - dump the register & bus value \n");
-  printf("input reg_num reg_val - set GPR reg_num to reg_val    \n");
-  printf("?                     - display this help menu        \n");
-  printf("quit                  - exit the program              \n\n");
+/***************************************************************/
+/*                                                             */
+/* Procedure : budget_left                                     */
+/*                                                             */
+/* Purpose   : Instructions left under INSTRUCTION_BUDGET      */
+/*             (-n), UINT64_MAX when there is no budget.       */
+/*                                                             */
+/***************************************************************/
+uint64_t budget_left (sim_context *ctx) {
+
+  if (ctx->INSTRUCTION_BUDGET == 0)
+    return UINT64_MAX;
+  if (ctx->INSTRUCTION_COUNT >= ctx->INSTRUCTION_BUDGET)
+    return 0;
+  return ctx->INSTRUCTION_BUDGET - ctx->INSTRUCTION_COUNT;
 }
 
 /***************************************************************/
@@ -135,11 +272,32 @@ void help () {
 /* Purpose   : Execute a cycle                                 */
 /*                                                             */
 /***************************************************************/
-void cycle () {
+void cycle (sim_context *ctx) {
 
-  process_instruction();
-  CURRENT_STATE = NEXT_STATE;
-  INSTRUCTION_COUNT++;
+  process_instruction(ctx);
+  COMMIT_STATE(ctx);
+  ctx->INSTRUCTION_COUNT++;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : halt_report                                     */
+/*                                                             */
+/* Purpose   : Write the reports of whatever models are on     */
+/*             (-p profile, cache, branch predictor and        */
+/*             pipeline statistics) once the program halts.    */
+/*                                                             */
+/***************************************************************/
+static void halt_report (sim_context *ctx) {
+
+  if (ctx->PROFILE != NULL)
+    profile_write(ctx);
+  if (ctx->CACHES != NULL)
+    cache_report(ctx, ctx->OUT);
+  if (ctx->BPRED != NULL)
+    bpred_report(ctx, ctx->OUT);
+  if (ctx->TIMING != NULL)
+    timing_report(ctx, ctx->OUT);
 }
 
 /***************************************************************/
@@ -149,23 +307,30 @@ void cycle () {
 /* Purpose   : Simulate ARMv4 for n cycles                     */
 /*                                                             */
 /***************************************************************/
-void run (int num_cycles) {
+void run (sim_context *ctx, int num_cycles) {
 
   int i;
 
-  if (RUN_BIT == FALSE) {
-    printf("Can't simulate, Simulator is halted\n\n");
+  if (ctx->RUN_BIT == FALSE) {
+    fprintf(ctx->OUT, "Can't simulate, Simulator is halted\n\n");
     return;
   }
 
-  printf("Simulating for %d cycles...\n\n", num_cycles);
-  for (i = 0; i < num_cycles; i++) {
-    if (RUN_BIT == FALSE) {
-      printf("Simulator halted\n\n");
-      break;
-    }
-    cycle();
+  fprintf(ctx->OUT, "Simulating for %d cycles...\n\n", num_cycles);
+  if (num_cycles > 0 && (uint64_t)num_cycles > budget_left(ctx))
+    num_cycles = budget_left(ctx);
+  if (ctx->BLOCK_MODE)
+    run_blocks(ctx, num_cycles);
+  else
+    for (i = 0; i < num_cycles && ctx->RUN_BIT; i++)
+      cycle(ctx);
+
+  if (ctx->RUN_BIT == FALSE) {
+    fprintf(ctx->OUT, "Simulator halted\n\n");
+    halt_report(ctx);
   }
+  else if (budget_left(ctx) == 0)
+    fprintf(ctx->OUT, "Instruction budget exhausted\n\n");
 }
 
 /***************************************************************/
@@ -175,17 +340,28 @@ void run (int num_cycles) {
 /* Purpose   : Simulate ARMv4 until HALTed                     */
 /*                                                             */
 /***************************************************************/
-void go () {
+void go (sim_context *ctx) {
 
-  if (RUN_BIT == FALSE) {
-    printf("Can't simulate, Simulator is halted\n\n");
+  uint64_t left;
+
+  if (ctx->RUN_BIT == FALSE) {
+    fprintf(ctx->OUT, "Can't simulate, Simulator is halted\n\n");
     return;
   }
 
-  printf("Simulating...\n\n");
-  while (RUN_BIT)
-    cycle();
-  printf("Simulator halted\n\n");
+  fprintf(ctx->OUT, "Simulating...\n\n");
+  while (ctx->RUN_BIT && (left = budget_left(ctx)) > 0) {
+    if (ctx->BLOCK_MODE)
+      run_blocks(ctx, left > INT_MAX ? INT_MAX : left);
+    else
+      cycle(ctx);
+  }
+  if (ctx->RUN_BIT)
+    fprintf(ctx->OUT, "Instruction budget exhausted\n\n");
+  else {
+    fprintf(ctx->OUT, "Simulator halted\n\n");
+    halt_report(ctx);
+  }
 }
 
 /***************************************************************/ 
@@ -193,26 +369,28 @@ void go () {
 /* Procedure : mdump                                           */
 /*                                                             */
 /* Purpose   : Dump a word-aligned region of memory to the     */
-/*             output file.                                    */
+/*             output and the dumpsim file (NULL for none).    */
 /*                                                             */
 /***************************************************************/
-void mdump (FILE * dumpsim_file, int start, int stop) {
+void mdump (sim_context *ctx, FILE * dumpsim_file, int start, int stop) {
 
   int address;
 
-  printf("\nMemory content [0x%08x..0x%08x] :\n", start, stop);
-  printf("-------------------------------------\n");
+  fprintf(ctx->OUT, "\nMemory content [0x%08x..0x%08x] :\n", start, stop);
+  fprintf(ctx->OUT, "-------------------------------------\n");
   for (address = start; address <= stop; address += 4)
-    printf("  0x%08x (%d) :\t0x%08x\n", 
-	   address, address, mem_read_32(address));
-  printf("\n");
+    fprintf(ctx->OUT, "  0x%08x (%d) :\t0x%08x\n", 
+	   address, address, mem_read_32(ctx, address));
+  fprintf(ctx->OUT, "\n");
 
-  /* dump the memory contents into the dumpsim file */
+  /* dump the memory contents into the dumpsim file, if there is one */
+  if (dumpsim_file == NULL)
+    return;
   fprintf(dumpsim_file, "\nMemory content [0x%08x..0x%08x] :\n", start, stop);
   fprintf(dumpsim_file, "-------------------------------------\n");
   for (address = start; address <= stop; address += 4)
     fprintf(dumpsim_file, "  0x%08x (%d) :\t0x%08x\n", 
-	    address, address, mem_read_32(address));
+	    address, address, mem_read_32(ctx, address));
   fprintf(dumpsim_file, "\n");
 }
 
@@ -220,169 +398,546 @@ void mdump (FILE * dumpsim_file, int start, int stop) {
 /*                                                             */
 /* Procedure : rdump                                           */
 /*                                                             */
-/* Purpose   : Dump current register and bus values to the     */   
-/*             output file.                                    */
+/* Purpose   : Dump current register and bus values to the     */
+/*             output and the dumpsim file (NULL for none).    */
 /*                                                             */
 /***************************************************************/
-void rdump (FILE * dumpsim_file) {
+void rdump (sim_context *ctx, FILE * dumpsim_file) {
 
   int k; 
 
-  printf("\nCurrent register/bus values :\n");
-  printf("-------------------------------------\n");
-  printf("Instruction Count : %u\n", INSTRUCTION_COUNT);
-  printf("Registers:\n");
+  flags_sync(ctx);
+  fprintf(ctx->OUT, "\nCurrent register/bus values :\n");
+  fprintf(ctx->OUT, "-------------------------------------\n");
+  fprintf(ctx->OUT, "Instruction Count : %llu\n", (unsigned long long)ctx->INSTRUCTION_COUNT);
+  fprintf(ctx->OUT, "Registers:\n");
   for (k = 0; k < ARM_REGS-1; k++)
-    printf("R%d:\t0x%08x\n", k, CURRENT_STATE.REGS[k]);
-  printf("PC:\t0x%08x\n", CURRENT_STATE.PC);
-  printf("CPSR:\t0x%08x\n", CURRENT_STATE.CPSR);
-  printf("\n");
+    fprintf(ctx->OUT, "R%d:\t0x%08x\n", k, ctx->CURRENT_STATE.REGS[k]);
+  fprintf(ctx->OUT, "PC:\t0x%08x\n", ctx->CURRENT_STATE.PC);
+  fprintf(ctx->OUT, "CPSR:\t0x%08x\n", ctx->CURRENT_STATE.CPSR);
+  fprintf(ctx->OUT, "\n");
 
-  /* dump the state information into the dumpsim file */
+  /* dump the state information into the dumpsim file, if there is one */
+  if (dumpsim_file == NULL)
+    return;
   fprintf(dumpsim_file, "\nCurrent register/bus values :\n");
   fprintf(dumpsim_file, "-------------------------------------\n");
-  fprintf(dumpsim_file, "Instruction Count : %u\n", INSTRUCTION_COUNT);
+  fprintf(dumpsim_file, "Instruction Count : %llu\n",
+          (unsigned long long)ctx->INSTRUCTION_COUNT);
   fprintf(dumpsim_file, "Registers:\n");
   for (k = 0; k < ARM_REGS-1; k++)
-    fprintf(dumpsim_file, "R%d: 0x%08x\n", k, CURRENT_STATE.REGS[k]);
-  fprintf(dumpsim_file, "PC                : 0x%08x\n", CURRENT_STATE.PC);
-  fprintf(dumpsim_file, "CPSR              : 0x%08x\n", CURRENT_STATE.CPSR);
+    fprintf(dumpsim_file, "R%d: 0x%08x\n", k, ctx->CURRENT_STATE.REGS[k]);
+  fprintf(dumpsim_file, "PC                : 0x%08x\n", ctx->CURRENT_STATE.PC);
+  fprintf(dumpsim_file, "CPSR              : 0x%08x\n", ctx->CURRENT_STATE.CPSR);
   fprintf(dumpsim_file, "\n");
 }
 
 /***************************************************************/
 /*                                                             */
-/* Procedure : get_command                                     */
+/* Procedure : set_trace_level                                 */
 /*                                                             */
-/* Purpose   : Read a command from standard input.             */  
+/* Purpose   : Set TRACE_LEVEL from none/instr/decode/full     */
+/*             (or 0-3).  Returns -1 for an unknown level.     */
+/*                                                             */
+/***************************************************************/
+int set_trace_level (sim_context *ctx, char *level) {
+
+  static char *names[] = { "none", "instr", "decode", "full" };
+  int i;
+
+  for (i = 0; i <= TRACE_FULL; i++) {
+    if (!strcmp(level, names[i]) || (level[0] == '0' + i && level[1] == '\0')) {
+#ifdef SIM_NO_TRACE
+      if (i != TRACE_NONE)
+        fprintf(ctx->OUT, "Tracing is not available in a SIM_NO_TRACE build\n");
+#else
+      ctx->TRACE_LEVEL = i;
+#endif
+      return 0;
+    }
+  }
+
+  fprintf(ctx->OUT, "Invalid trace level %s\n", level);
+  return -1;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : do_command                                      */
+/*                                                             */
+/* Purpose   : Carry out one command line.  Returns 0 when it  */
+/*             ran, 1 for a bad command or argument and -1 for */
+/*             quit.  Blank lines and # comments do nothing.   */
 /*                                                             */
 /***************************************************************/
-void get_command (FILE * dumpsim_file) {
+int do_command (sim_context *ctx, FILE * dumpsim_file, char *line) {
 
-  char buffer[20];
+  char cmd[16], level[16], filename[COMMAND_LINE_MAX];
   int start, stop, cycles;
   int register_no, register_value;
 
-  printf("ARM-SIM> ");
+  if (sscanf(line, "%15s", cmd) != 1 || cmd[0] == '#')
+    return 0;
 
-  if (scanf("%s", buffer) == EOF)
-    exit(0);
+  switch(cmd[0]) {
+  case 'B':
+  case 'b':
+    if (strcasecmp(cmd, "bpred"))
+      break;
+    if (ctx->BPRED == NULL) {
+      fprintf(ctx->OUT, "No branch predictor, start the simulator with --bpred\n");
+      return 1;
+    }
+    bpred_report(ctx, ctx->OUT);
+    if (dumpsim_file != NULL)
+      bpred_report(ctx, dumpsim_file);
+    return 0;
+
+  case 'C':
+  case 'c':
+    if (!strcasecmp(cmd, "cache")) {
+      if (ctx->CACHES == NULL) {
+        fprintf(ctx->OUT, "No cache model, start the simulator with --icache or --dcache\n");
+        return 1;
+      }
+      cache_report(ctx, ctx->OUT);
+      if (dumpsim_file != NULL)
+        cache_report(ctx, dumpsim_file);
+      return 0;
+    }
+    if (strcasecmp(cmd, "checkpoint") || sscanf(line, "%*s %255s", filename) != 1)
+      break;
+    return checkpoint(ctx, filename) < 0;
 
-  printf("\n");
+  case 'F':
+  case 'f':
+    if (strcasecmp(cmd, "fork-run"))
+      break;
+    line += strspn(line, " \t");
+    return fork_run(ctx, line + strcspn(line, " \t\r\n"));
 
-  switch(buffer[0]) {
   case 'G':
   case 'g':
-    go();
-    break;
+    go(ctx);
+    return 0;
 
   case 'M':
   case 'm':
-    if (scanf("%i %i", &start, &stop) != 2)
+    if (sscanf(line, "%*s %i %i", &start, &stop) != 2)
       break;
 
-    mdump(dumpsim_file, start, stop);
-    break;
+    mdump(ctx, dumpsim_file, start, stop);
+    return 0;
 
   case '?':
-    help();
-    break;
+    help(ctx->OUT);
+    return 0;
+
+  case 'P':
+  case 'p':
+    if (strcasecmp(cmd, "profile"))
+      break;
+    if (ctx->PROFILE == NULL) {
+      fprintf(ctx->OUT, "Profiling is off, start the simulator with -p\n");
+      return 1;
+    }
+    profile_report(ctx, ctx->OUT);
+    if (dumpsim_file != NULL)
+      profile_report(ctx, dumpsim_file);
+    return 0;
 
   case 'Q':
   case 'q':
-    printf("Bye.\n");
-    exit(0);
+    fprintf(ctx->OUT, "Bye.\n");
+    return -1;
 
   case 'R':
   case 'r':
-    if (buffer[1] == 'd' || buffer[1] == 'D')
-      rdump(dumpsim_file);
+    if (cmd[1] == 'd' || cmd[1] == 'D')
+      rdump(ctx, dumpsim_file);
+    else if (!strcasecmp(cmd, "restore")) {
+      if (sscanf(line, "%*s %255s", filename) != 1) break;
+      return restore(ctx, filename) < 0;
+    }
     else {
-      if (scanf("%d", &cycles) != 1) break;
-      run(cycles);
+      if (sscanf(line, "%*s %d", &cycles) != 1) break;
+      run(ctx, cycles);
     }
-    break;
+    return 0;
 
   case 'I':
   case 'i':
-    if (scanf("%i %i", &register_no, &register_value) != 2)
+    if (sscanf(line, "%*s %i %i", &register_no, &register_value) != 2 ||
+        register_no < 0 || register_no >= ARM_REGS)
       break;
-    CURRENT_STATE.REGS[register_no] = register_value;
-    NEXT_STATE.REGS[register_no] = register_value;
-    break;
+    ctx->CURRENT_STATE.REGS[register_no] = register_value;
+    ctx->NEXT_STATE.REGS[register_no] = register_value;
+    if (ctx->BTRACE != NULL) {
+      flags_sync(ctx);
+      btrace_sync(ctx, ctx->CURRENT_STATE.CPSR >> 28);
+    }
+    return 0;
+
+  case 'T':
+  case 't':
+    if (!strcasecmp(cmd, "timing")) {
+      if (ctx->TIMING == NULL) {
+        fprintf(ctx->OUT, "No timing model, start the simulator with --timing\n");
+        return 1;
+      }
+      timing_report(ctx, ctx->OUT);
+      if (dumpsim_file != NULL)
+        timing_report(ctx, dumpsim_file);
+      return 0;
+    }
+    if (sscanf(line, "%*s %15s", level) != 1)
+      break;
+    return set_trace_level(ctx, level) < 0;
+
   default:
-    printf("Invalid Command\n");
     break;
   }
+  fprintf(ctx->OUT, "Invalid Command\n");
+  return 1;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : get_command                                     */
+/*                                                             */
+/* Purpose   : Read a command from standard input.             */  
+/*                                                             */
+/***************************************************************/
+void get_command (sim_context *ctx, FILE * dumpsim_file) {
+
+  char line[COMMAND_LINE_MAX];
+
+  fprintf(ctx->OUT, "ARM-SIM> ");
+
+  if (fgets(line, sizeof(line), stdin) == NULL) {
+    btrace_close(ctx);
+    exit(0);
+  }
+
+  fprintf(ctx->OUT, "\n");
+
+  if (do_command(ctx, dumpsim_file, line) < 0) {
+    btrace_close(ctx);
+    exit(0);
+  }
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run_commands                                    */
+/*                                                             */
+/* Purpose   : Batch mode.  Run the ';' or newline separated   */
+/*             commands in text without a prompt, stopping at  */
+/*             quit or the first bad command.  Returns 1 after */
+/*             a bad command, -1 after quit, else 0.           */
+/*                                                             */
+/***************************************************************/
+int run_commands (sim_context *ctx, FILE * dumpsim_file, char *text) {
+
+  char line[COMMAND_LINE_MAX];
+  int status;
+  size_t len;
+
+  while (*text != '\0') {
+    len = strcspn(text, ";\n");
+    if (len >= sizeof(line)) {
+      fprintf(ctx->OUT, "Command too long\n");
+      return 1;
+    }
+    memcpy(line, text, len);
+    line[len] = '\0';
+    text += len;
+    if (*text != '\0')
+      text++;
+
+    if ((status = do_command(ctx, dumpsim_file, line)) != 0)
+      return status;
+  }
+  return 0;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : run_script                                      */
+/*                                                             */
+/* Purpose   : Batch mode on a script file, one or more        */
+/*             commands per line.  Same return as run_commands.*/
+/*                                                             */
+/***************************************************************/
+int run_script (sim_context *ctx, FILE * dumpsim_file, char *script_filename) {
+
+  FILE * script;
+  char line[COMMAND_LINE_MAX];
+  int status = 0;
+
+  if ((script = fopen(script_filename, "r")) == NULL) {
+    fprintf(ctx->OUT, "Error: Can't open script file %s\n", script_filename);
+    return 1;
+  }
+  while (status == 0 && fgets(line, sizeof(line), script) != NULL)
+    status = run_commands(ctx, dumpsim_file, line);
+  fclose(script);
+  return status;
 }
 
 /***************************************************************/
 /*                                                             */
 /* Procedure : init_memory                                     */
 /*                                                             */
-/* Purpose   : Allocate and zero memory                        */
+/* Purpose   : Map zeroed memory for every region and enter it */
+/*             in PAGE_TABLE.  Returns -1 if a mapping fails.  */
 /*                                                             */
 /***************************************************************/
-void init_memory () {
+static int init_memory (sim_context *ctx) {
 
   int i;
+  uint32_t offset;
+
+  ctx->PAGE_TABLE = calloc(PAGE_COUNT, sizeof(uint8_t *));
+  if (ctx->PAGE_TABLE == NULL)
+    return -1;
   for (i = 0; i < MEM_NREGIONS; i++) {
-    MEM_REGIONS[i].mem = malloc(MEM_REGIONS[i].size);
-    memset(MEM_REGIONS[i].mem, 0, MEM_REGIONS[i].size);
+    /*
+       Anonymous private mappings: the kernel hands out a zero page on
+       first touch, so an untouched region costs neither startup time
+       nor resident memory and the sizes can grow freely.
+    */
+    ctx->MEM_REGIONS[i] = MEM_MAP[i];
+    ctx->MEM_REGIONS[i].mem = mmap(NULL, ctx->MEM_REGIONS[i].size,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                   -1, 0);
+    if (ctx->MEM_REGIONS[i].mem == MAP_FAILED) {
+      ctx->MEM_REGIONS[i].mem = NULL;
+      return -1;
+    }
+    for (offset = 0; offset < ctx->MEM_REGIONS[i].size; offset += PAGE_SIZE)
+      ctx->PAGE_TABLE[(ctx->MEM_REGIONS[i].start + offset) >> PAGE_SHIFT] =
+        ctx->MEM_REGIONS[i].mem + offset;
   }
+  return 0;
 }
 
+/***************************************************************/
+/*                                                             */
+/* Procedure : sim_create                                      */
+/*                                                             */
+/* Purpose   : Allocate a machine with zeroed memory and       */
+/*             registers, tracing at full to stdout and no     */
+/*             budget.  Returns NULL if memory can't be had.   */
+/*                                                             */
+/***************************************************************/
+sim_context *sim_create () {
+
+  sim_context *ctx = calloc(1, sizeof(sim_context));
+
+  if (ctx == NULL)
+    return NULL;
+  ctx->TRACE_LEVEL = TRACE_FULL;
+  ctx->OUT = stdout;
+  if (init_memory(ctx) < 0) {
+    sim_destroy(ctx);
+    return NULL;
+  }
+  predecode_init(ctx);
+  return ctx;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : sim_destroy                                     */
+/*                                                             */
+/* Purpose   : Free a machine made by sim_create               */
+/*                                                             */
+/***************************************************************/
+void sim_destroy (sim_context *ctx) {
+
+  int i;
+
+  predecode_free(ctx);
+  profile_free(ctx);
+  cache_free(ctx);
+  bpred_free(ctx);
+  timing_free(ctx);
+  btrace_close(ctx);
+  free_symbols(ctx);
+  for (i = 0; i < MEM_NREGIONS; i++)
+    if (ctx->MEM_REGIONS[i].mem != NULL)
+      munmap(ctx->MEM_REGIONS[i].mem, ctx->MEM_REGIONS[i].size);
+  free(ctx->PAGE_TABLE);
+  free(ctx);
+}
+
+/*
+   Hex digit values plus one, zero for anything that is not a hex
+   digit, so the loader converts and validates with one lookup.
+*/
+static const uint8_t HEX_DIGIT[256] = {
+  ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+  ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+  ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+  ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+#define HEX_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
 /**************************************************************/
 /*                                                            */
 /* Procedure : load_program                                   */
 /*                                                            */
 /* Purpose   : Load program and service routines into mem.    */
+/*             An ELF file goes to load_elf; anything else is */
+/*             hex words, one or more per line (an optional   */
+/*             0x prefix, blank lines allowed), mapped and    */
+/*             parsed in place and stored straight into text. */
+/*             Returns -1, after reporting every malformed    */
+/*             line, if the file can't be opened or isn't a   */
+/*             clean image.                                   */
 /*                                                            */
 /**************************************************************/
-void load_program (char *program_filename) {
+int load_program (sim_context *ctx, char *program_filename) {
 
-  FILE * prog;
-  int ii, word;
+  /* text is one region, so its first page is the whole backing store */
+  uint8_t *text = ctx->PAGE_TABLE[MEM_TEXT_START >> PAGE_SHIFT];
+  const char *p, *end, *token;
+  struct stat st;
+  char *image = NULL;
+  int fd, line = 1, bad = 0;
+  uint32_t ii = 0, word, digit, k;
 
   /* Open program file. */
-  prog = fopen(program_filename, "r");
-  if (prog == NULL) {
-    printf("Error: Can't open program file %s\n", program_filename);
-    exit(-1);
+  fd = open(program_filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(ctx->OUT, "Error: Can't open program file %s\n", program_filename);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  if (st.st_size > 0) {
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) {
+      fprintf(ctx->OUT, "Error: Can't map program file %s\n", program_filename);
+      close(fd);
+      return -1;
+    }
   }
+  if (st.st_size >= SELFMAG && !memcmp(image, ELFMAG, SELFMAG)) {
+    bad = load_elf(ctx, program_filename, fd, (uint8_t *)image, st.st_size);
+    munmap(image, st.st_size);
+    close(fd);
+    return bad;
+  }
+  close(fd);
 
   /* Read in the program. */
+  p = image;
+  end = image + st.st_size;
+  while (p < end) {
+    while (p < end && HEX_SPACE(*p))
+      p++;
+    if (p == end)
+      break;
+    if (*p == '\n') {
+      p++;
+      line++;
+      continue;
+    }
 
-  ii = 0;
-  while (fscanf(prog, "%x\n", &word) != EOF) {
-    mem_write_32(MEM_TEXT_START + ii, word);
-    ii += 4;
+    token = p;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') &&
+        HEX_DIGIT[(uint8_t)p[2]])
+      p += 2;
+    word = 0;
+    for (k = 0; p < end && (digit = HEX_DIGIT[(uint8_t)*p]) != 0; k++, p++)
+      word = (word << 4) | (digit - 1);
+
+    if (k == 0 || k > 8 || (p < end && !HEX_SPACE(*p) && *p != '\n')) {
+      while (p < end && !HEX_SPACE(*p) && *p != '\n')
+        p++;
+      fprintf(ctx->OUT, "Error: %s:%d: malformed word '%.*s'\n",
+              program_filename, line, (int)(p - token), token);
+      bad++;
+    }
+    else if (ii >= MEM_TEXT_SIZE) {
+      fprintf(ctx->OUT, "Error: %s:%d: program does not fit in text\n",
+              program_filename, line);
+      bad++;
+      break;
+    }
+    else {
+      word = GUEST_32(word);
+      memcpy(text + ii, &word, 4);
+      ii += 4;
+    }
   }
+  if (image != NULL)
+    munmap(image, st.st_size);
 
-  CURRENT_STATE.PC = MEM_TEXT_START;
+  /* the stores bypassed mem_write_32, so drop stale predecodes here */
+  for (k = 0; k < ii; k += 4)
+    predecode_invalidate(ctx, MEM_TEXT_START + k);
 
-  printf("Read %d words from program into memory.\n\n", ii/4);
+  if (bad)
+    return -1;
+
+  ctx->CURRENT_STATE.PC = MEM_TEXT_START;
+
+  fprintf(ctx->OUT, "Read %d words from program into memory.\n\n", ii/4);
+  return 0;
 }
 
 /************************************************************/
 /*                                                          */
 /* Procedure : initialize                                   */
 /*                                                          */
-/* Purpose   : Load machine language program                */ 
+/* Purpose   : Load machine language program                */
 /*             and set up initial state of the machine.     */
+/*             Returns -1 if a file can't be loaded.        */
 /*                                                          */
 /************************************************************/
-void initialize (char *program_filename, int num_prog_files) {
+int initialize (sim_context *ctx, char **program_filenames, int num_prog_files) {
 
   int i;
 
-  init_memory();
-  for ( i = 0; i < num_prog_files; i++ ) {
-    load_program(program_filename);
-    while(*program_filename++ != '\0');
-  }
-  NEXT_STATE = CURRENT_STATE;    
-  RUN_BIT = TRUE;
+  for ( i = 0; i < num_prog_files; i++ )
+    if (load_program(ctx, program_filenames[i]) < 0)
+      return -1;
+  ctx->NEXT_STATE = ctx->CURRENT_STATE;
+  ctx->RUN_BIT = TRUE;
+  return 0;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : batch                                           */
+/*                                                             */
+/* Purpose   : Run the script, then the commands (either may   */
+/*             be NULL) and return the batch exit status:      */
+/*                                                             */
+/*   0 - the program halted                                    */
+/*   1 - a bad command, argument or script                     */
+/*   2 - stopped by the -n instruction budget                  */
+/*   3 - the commands ran out with the program still running   */
+/*                                                             */
+/***************************************************************/
+int batch (sim_context *ctx, FILE * dumpsim_file, char *script_filename, char *commands) {
+
+  int status = 0;
+
+  if (script_filename != NULL)
+    status = run_script(ctx, dumpsim_file, script_filename);
+  if (status == 0 && commands != NULL)
+    status = run_commands(ctx, dumpsim_file, commands);
+  if (status > 0)
+    return 1;
+  if (ctx->RUN_BIT == FALSE)
+    return 0;
+  return budget_left(ctx) == 0 ? 2 : 3;
 }
 
 /***************************************************************/
@@ -393,24 +948,185 @@ void initialize (char *program_filename, int num_prog_files) {
 int main (int argc, char *argv[]) {
 
   FILE * dumpsim_file;
+  sim_context *ctx;
+  int arg = 1;
+  int bench_mode = FALSE;
+  char *batch_commands = NULL, *batch_script = NULL;
+  int job_mode = FALSE, job_threads = 0;
+  char *manifest = NULL, *job_outdir = ".";
+  char *restore_file = NULL, *trace_file = NULL;
+  char **job_files;
+  int num_jobs, status;
+  cache_config cache;
+  bpred_config predictor;
+  timing_config timing;
+
+  if ((ctx = sim_create()) == NULL) {
+    printf("Error: Can't allocate simulator memory\n");
+    exit(1);
+  }
+
+  /* Options come before the program files */
+  while (arg < argc && argv[arg][0] == '-') {
+    if (!strcmp(argv[arg], "-t") && arg + 1 < argc) {
+      if (set_trace_level(ctx, argv[arg + 1]) < 0)
+        exit(1);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-b")) {
+      ctx->BLOCK_MODE = TRUE;
+      arg++;
+    }
+    else if (!strcmp(argv[arg], "--bench")) {
+      bench_mode = TRUE;
+      arg++;
+    }
+    else if (!strcmp(argv[arg], "-c") && arg + 1 < argc) {
+      batch_commands = argv[arg + 1];
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-s") && arg + 1 < argc) {
+      batch_script = argv[arg + 1];
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+      char *end;
+
+      ctx->INSTRUCTION_BUDGET = strtoull(argv[arg + 1], &end, 0);
+      if (end == argv[arg + 1] || *end != '\0' || argv[arg + 1][0] == '-') {
+        printf("Error: bad instruction budget %s\n", argv[arg + 1]);
+        exit(1);
+      }
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-p") && arg + 1 < argc) {
+      profile_enable(ctx, argv[arg + 1]);
+      arg += 2;
+    }
+    else if ((!strcmp(argv[arg], "--icache") || !strcmp(argv[arg], "--dcache")) &&
+             arg + 1 < argc) {
+      if (cache_parse(argv[arg + 1], &cache) < 0) {
+        printf("Error: bad cache %s, want size[:ways[:line[:lru|fifo|random[:wb|wt]]]]\n",
+               argv[arg + 1]);
+        exit(1);
+      }
+      cache_enable(ctx, argv[arg][2] == 'd', &cache);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "--bpred") && arg + 1 < argc) {
+      if (bpred_parse(argv[arg + 1], &predictor) < 0) {
+        printf("Error: bad predictor %s, want static|bimodal[:bits]|gshare[:bits[:history]]"
+               "[,ras[:depth]]\n", argv[arg + 1]);
+        exit(1);
+      }
+      bpred_enable(ctx, &predictor);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "--timing") && arg + 1 < argc) {
+      if (timing_load(argv[arg + 1], &timing, stdout) < 0)
+        exit(1);
+      timing_enable(ctx, &timing);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "--trace-file") && arg + 1 < argc) {
+      trace_file = argv[arg + 1];
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "--restore") && arg + 1 < argc) {
+      restore_file = argv[arg + 1];
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-j") && arg + 1 < argc) {
+      job_mode = TRUE;
+      job_threads = atoi(argv[arg + 1]);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-m") && arg + 1 < argc) {
+      job_mode = TRUE;
+      manifest = argv[arg + 1];
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-o") && arg + 1 < argc) {
+      job_outdir = argv[arg + 1];
+      arg += 2;
+    }
+    else
+      break;
+  }
+
+  /* --bench runs the built-in workloads instead of a program */
+  if (bench_mode) {
+    if (trace_file != NULL && btrace_open(ctx, trace_file) < 0)
+      exit(1);
+    bench(ctx, arg < argc ? atoi(argv[arg]) : BENCH_INSTRUCTIONS);
+    btrace_close(ctx);
+    exit(0);
+  }
+
+  /* -j/-m run every program file (and manifest entry) as its own job */
+  if (job_mode) {
+    job_files = argv + arg;
+    num_jobs = argc - arg;
+    if (manifest != NULL) {
+      char **listed;
+      int num_listed, i;
+
+      if ((listed = read_manifest(manifest, &num_listed)) == NULL)
+        exit(1);
+      job_files = malloc((num_jobs + num_listed) * sizeof(char *));
+      memcpy(job_files, argv + arg, num_jobs * sizeof(char *));
+      for (i = 0; i < num_listed; i++)
+        job_files[num_jobs++] = listed[i];
+    }
+    if (num_jobs == 0) {
+      printf("Error: no program files to run\n");
+      exit(1);
+    }
+    if (batch_commands == NULL && batch_script == NULL)
+      batch_commands = "go; rdump";
+    status = run_jobs(ctx, job_files, num_jobs, job_threads, job_outdir,
+                      batch_script, batch_commands, trace_file != NULL);
+    exit(status);
+  }
 
   /* Error Checking */
-  if (argc < 2) {
-    printf("Error: usage: %s <program_file_1> <program_file_2> ...\n",
-           argv[0]);
+  if (arg >= argc && restore_file == NULL) {
+    printf("Error: usage: %s [-b] [-t none|instr|decode|full] [-n instructions]\n"
+           "              [-c \"cmd; cmd ...\"] [-s script] [-p profile] [--restore checkpoint]\n"
+           "              [--icache size:ways:line:lru|fifo|random] [--dcache size:ways:line:policy:wb|wt]\n"
+           "              [--bpred static|bimodal:bits|gshare:bits:history[,ras:depth]]\n"
+           "              [--timing latency_file] [--trace-file trace]\n"
+           "              <program_file_1> <program_file_2> ...\n"
+           "       %s [-b] [-t level] [-n instructions] [-c cmds] [-s script] [-p]\n"
+           "              -j threads [-m manifest] [-o outdir] <program_file> ...\n"
+           "       %s [-b] --bench [instructions]\n",
+           argv[0], argv[0], argv[0]);
     exit(1);
   }
 
   printf("ARMv4 Simulator\n\n");
 
-  initialize(argv[1], argc - 1);
+  if (initialize(ctx, argv + arg, argc - arg) < 0)
+    exit(1);
+  if (restore_file != NULL && restore(ctx, restore_file) < 0)
+    exit(1);
+  if (trace_file != NULL && btrace_open(ctx, trace_file) < 0)
+    exit(1);
 
   if ( (dumpsim_file = fopen( "dumpsim", "w" )) == NULL ) {
     printf("Error: Can't open dumpsim file\n");
-    exit(-1);
+    exit(1);
+  }
+
+  /* Batch mode (-s, -c, script first) exits with the batch() status */
+  if (batch_commands != NULL || batch_script != NULL) {
+    status = batch(ctx, dumpsim_file, batch_script, batch_commands);
+    fclose(dumpsim_file);
+    btrace_close(ctx);
+    exit(status);
   }
 
   while (1)
-    get_command(dumpsim_file);
+    get_command(ctx, dumpsim_file);
     
 }
@@ -15,6 +15,8 @@
 #ifndef _SIM_SHELL_H_
 #define _SIM_SHELL_H_
 
+#include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define FALSE 0
@@ -29,11 +31,148 @@ typedef struct CPU_State_Struct {
   uint32_t CPSR; /* current program status register */
 } CPU_State;
 
-extern CPU_State CURRENT_STATE, NEXT_STATE;
-extern int RUN_BIT;	/* run bit */
+/* Memory map, see MEM_REGIONS in shell.c */
+#define MEM_DATA_START  0x10000000
+#define MEM_DATA_SIZE   0x00100000
+#define MEM_TEXT_START  0x00400000
+#define MEM_TEXT_SIZE   0x00100000
+#define MEM_STACK_START 0x7ff00000
+#define MEM_STACK_SIZE  0x00100000
+#define MEM_KDATA_START 0x90000000
+#define MEM_KDATA_SIZE  0x00100000
+#define MEM_KTEXT_START 0x80000000
+#define MEM_KTEXT_SIZE  0x00100000
 
-uint32_t mem_read_32 (uint32_t address);
-void     mem_write_32 (uint32_t address, uint32_t value);
-void process_instruction ();
+/*
+   The state instructions write.  There is a single architectural
+   state, updated in place, unless built with -DSIM_DOUBLE_BUFFER:
+   then handlers write NEXT_STATE and COMMIT_STATE() copies it into
+   CURRENT_STATE after each instruction, which is handy for checking
+   a handler against the old model.  ARCH_STATE names a sim_context
+   member: ctx->ARCH_STATE.
+*/
+#ifdef SIM_DOUBLE_BUFFER
+#define ARCH_STATE NEXT_STATE
+#define COMMIT_STATE(ctx) ((ctx)->CURRENT_STATE = (ctx)->NEXT_STATE)
+#else
+#define ARCH_STATE CURRENT_STATE
+#define COMMIT_STATE(ctx) ((void)0)
+#endif
+
+/* Last flag-setting operation, NZCV is worked out from it (isa.h) */
+typedef struct {
+  int      kind;
+  uint32_t result;
+  uint32_t carry;
+  uint32_t a, b, vres;
+} lazy_flags;
+
+typedef struct {
+  uint32_t start, size;
+  uint8_t *mem;
+} mem_region_t;
+
+#define MEM_NREGIONS 5
+
+/* A symbol from a loaded ELF file (elf.c) */
+typedef struct {
+  uint32_t address, size;	/* size 0 for plain labels */
+  char *name;
+} sim_symbol;
+
+/*
+   One simulated machine.  Everything an instruction, a memory access
+   or a shell command touches hangs off the context, so a process can
+   run any number of machines side by side.  Create one with
+   sim_create and release it with sim_destroy.
+*/
+typedef struct sim_context {
+
+  CPU_State CURRENT_STATE, NEXT_STATE;
+  lazy_flags FLAGS;		/* pending NZCV, see isa.h */
+  int RUN_BIT;			/* run bit */
+  uint64_t INSTRUCTION_COUNT;
+  uint64_t INSTRUCTION_BUDGET;	/* run/go stop at this count (-n), 0 = none */
+  int BLOCK_MODE;		/* run/go use run_blocks (-b) */
+  int TRACE_LEVEL;		/* see TRACE_* below */
+  FILE *OUT;			/* shell and trace output, stdout by default */
+
+  mem_region_t MEM_REGIONS[MEM_NREGIONS];
+  uint8_t **PAGE_TABLE;		/* host page per guest page, see shell.c */
+  sim_symbol *SYMBOLS;		/* sorted by address */
+  int NUM_SYMBOLS;
+
+  /* predecode and block caches, owned by sim.c */
+  struct predecode_entry *PREDECODE;
+  struct sim_block **BLOCK_MAP;
+  struct sim_block *BLOCK_LIST;
+  int BLOCKS_STALE;
+
+  struct sim_profile *PROFILE;	/* -p counters (profile.h), NULL when off */
+  struct sim_caches *CACHES;	/* --icache/--dcache models (cache.h), NULL when off */
+  struct sim_bpred *BPRED;	/* --bpred model (bpred.h), NULL when off */
+  struct sim_timing *TIMING;	/* --timing pipeline model (timing.h), NULL when off */
+  struct sim_btrace *BTRACE;	/* --trace-file writer (btrace.h), NULL when off */
+} sim_context;
+
+/* longest shell or batch command line */
+#define COMMAND_LINE_MAX 256
+
+/*
+   Per-instruction trace output, set with -t on the command line or the
+   trace shell command.  Building with -DSIM_NO_TRACE removes tracing.
+*/
+#define TRACE_NONE   0
+#define TRACE_INSTR  1
+#define TRACE_DECODE 2
+#define TRACE_FULL   3
+
+sim_context *sim_create ();
+void sim_destroy (sim_context *ctx);
+
+uint32_t mem_read_32 (sim_context *ctx, uint32_t address);
+uint16_t mem_read_16 (sim_context *ctx, uint32_t address);
+uint8_t  mem_read_8 (sim_context *ctx, uint32_t address);
+void     mem_write_32 (sim_context *ctx, uint32_t address, uint32_t value);
+void     mem_write_16 (sim_context *ctx, uint32_t address, uint16_t value);
+void     mem_write_8 (sim_context *ctx, uint32_t address, uint8_t value);
+void process_instruction (sim_context *ctx);
+void predecode_init (sim_context *ctx);
+void predecode_free (sim_context *ctx);
+void predecode_invalidate (sim_context *ctx, uint32_t address);
+int  run_blocks (sim_context *ctx, int num_cycles);
+void flags_sync (sim_context *ctx);
+void cycle (sim_context *ctx);
+int  load_elf (sim_context *ctx, char *filename, int fd, const uint8_t *image, size_t size);
+const sim_symbol *symbol_lookup (sim_context *ctx, uint32_t address);
+char *symbol_name (sim_context *ctx, uint32_t address);
+void free_symbols (sim_context *ctx);
+void rdump (sim_context *ctx, FILE *dumpsim_file);
+int  fork_run (sim_context *ctx, char *variants);
+void profile_enable (sim_context *ctx, char *filename);
+void profile_free (sim_context *ctx);
+void profile_report (sim_context *ctx, FILE *out);
+void profile_json (sim_context *ctx, FILE *out);
+void profile_write (sim_context *ctx);
+int  checkpoint (sim_context *ctx, char *filename);
+int  restore (sim_context *ctx, char *filename);
+int  initialize (sim_context *ctx, char **program_filenames, int num_prog_files);
+int  batch (sim_context *ctx, FILE *dumpsim_file, char *script_filename, char *commands);
+
+/* --bench instruction budget per workload when none is given */
+#define BENCH_INSTRUCTIONS 20000000
+void bench (sim_context *ctx, int num_instructions);
+
+/*
+   -j/-m job runner (jobs.c): every program file is a job on its own
+   machine, set up like options (block mode, trace level, budget,
+   profiling), and its output goes to <outdir>/<program basename>.out
+   (and .profile with -p, .trace when trace is set by --trace-file).
+   nthreads 0 means one thread per online core.  Returns the exit
+   status of the worst job.
+*/
+int run_jobs (const sim_context *options, char **program_filenames, int num_prog_files,
+              int nthreads, char *outdir, char *script_filename, char *commands, int trace);
+char **read_manifest (char *manifest_filename, int *num_prog_files);
 
 #endif
@@ -12,11 +12,19 @@
 #include <string.h>
 #include "shell.h"
 #include "isa.h"
+#include "decode.h"
+#include "profile.h"
+#include "bpred.h"
+#include "timing.h"
+#include "btrace.h"
 
 
+#ifndef SIM_NO_TRACE
+
+/* per-thread buffers, the job runner traces from several threads */
 char *byte_to_binary12 (int x) {
 
-  static char b[13];
+  static __thread char b[13];
   b[0] = '\0';
 
   int z;
@@ -29,7 +37,7 @@ char *byte_to_binary12 (int x) {
 
 char *byte_to_binary4 (int x) {
 
-  static char b[5];
+  static __thread char b[5];
   b[0] = '\0';
 
   int z;
@@ -42,7 +50,7 @@ char *byte_to_binary4 (int x) {
 
 char *byte_to_binary32(int x) {
 
-  static char b[33];
+  static __thread char b[33];
   b[0] = '\0';
 
   unsigned int z;
@@ -53,24 +61,12 @@ char *byte_to_binary32(int x) {
   return b;
 }
 
-int bchar_to_int(char* rsa) {
-
-  int i = 0;
-  int result = 0;
-  int t = 0;
-  while(rsa[i] != '\0')i++;
-  while(i>0)
-    {
-      --i;
-      // printf("%d\n", (rsa[i]-'0')<<t);
-      result += (rsa[i] - '0')<<t;
-      t++;
-    }
-  return result;
-}
+#endif
 
+/* Every data processing handler in isa.h has this signature */
+typedef int (*dp_fn)(sim_context *ctx, int Rd, int Rn, int Operand2, int I, int S);
 
-int data_process(char* i_) {
+int data_process(sim_context *ctx, const decoded_inst *d) {
 
   /*
     This function further decode and execute subset of data processing
@@ -94,389 +90,472 @@ int data_process(char* i_) {
     1111 = MVN - Rd:= NOT Op2
   */
 
-  char d_opcode[5];
-  d_opcode[0] = i_[7];
-  d_opcode[1] = i_[8];
-  d_opcode[2] = i_[9];
-  d_opcode[3] = i_[10];
-  d_opcode[4] = '\0';
-  char d_cond[5];
-  d_cond[0] = i_[0];
-  d_cond[1] = i_[1];
-  d_cond[2] = i_[2];
-  d_cond[3] = i_[3];
-  d_cond[4] = '\0';
-  char rn[5]; rn[4] = '\0';
-  char rd[5]; rd[4] = '\0';
-  char operand2[13]; operand2[12] = '\0';
-  for(int i = 0; i < 4; i++) {
-    rn[i] = i_[12+i];
-    rd[i] = i_[16+i];
-  }
-
-  for(int i = 0; i < 12; i++) {
-    operand2[i] = i_[20+i];
-  }
-
-  int Rn = bchar_to_int(rn);
-  int Rd = bchar_to_int(rd);
-  int Operand2 = bchar_to_int(operand2);
-  int I = i_[6]-'0';
-  int S = i_[11]-'0';
-  int CC = bchar_to_int(d_cond);  //CC stand for condition code
-  printf("Opcode = %s\n Rn = %d\n Rd = %d\n Operand2 = %s\n I = %d\n S = %d\n COND = %s\n", d_opcode, Rn, Rd, byte_to_binary12(Operand2), I, S, byte_to_binary4(CC));
-  printf("\n");
-
-  /* Example - use and replicate */
-  //Add command ADD
-  if(!strcmp(d_opcode,"0100")) {
-    printf("--- This is an ADD instruction. \n");
-    ADD(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
-
-
-  //Subtraction command SUB
-  if(!strcmp(d_opcode,"0010")) {
-    printf("--- This is an SUB instruction. \n");
-    SUB(Rd, Rn, Operand2, I, S, CC);
-    return 0;
+  int Rn = d->Rn;
+  int Rd = d->Rd;
+  int Operand2 = d->operand2;
+  int I = d->I;
+  int S = d->S;
+  /*
+     The mnemonic was looked up from opcode and shift type at decode
+     time, so dispatch is a single indexed jump.  GCC gets one label
+     per handler (a direct call it can inline); other compilers go
+     through the function pointer table.
+  */
+#if defined(__GNUC__)
+  static void *const dispatch[OP_ROR + 1] = {
+    &&do_AND, &&do_EOR, &&do_SUB, &&do_undef, &&do_ADD, &&do_ADC, &&do_SBC, &&do_undef,
+    &&do_TST, &&do_TEQ, &&do_CMP, &&do_CMN, &&do_ORR, &&do_MOV, &&do_BIC, &&do_MVN,
+    &&do_LSL, &&do_LSR, &&do_ASR, &&do_ROR
+  };
+
+  goto *dispatch[d->op];
+
+ do_AND: return AND(ctx, Rd, Rn, Operand2, I, S);
+ do_EOR: return EOR(ctx, Rd, Rn, Operand2, I, S);
+ do_SUB: return SUB(ctx, Rd, Rn, Operand2, I, S);
+ do_ADD: return ADD(ctx, Rd, Rn, Operand2, I, S);
+ do_ADC: return ADC(ctx, Rd, Rn, Operand2, I, S);
+ do_SBC: return SBC(ctx, Rd, Rn, Operand2, I, S);
+ do_TST: return TST(ctx, Rd, Rn, Operand2, I, S);
+ do_TEQ: return TEQ(ctx, Rd, Rn, Operand2, I, S);
+ do_CMP: return CMP(ctx, Rd, Rn, Operand2, I, S);
+ do_CMN: return CMN(ctx, Rd, Rn, Operand2, I, S);
+ do_ORR: return ORR(ctx, Rd, Rn, Operand2, I, S);
+ do_MOV: return MOV(ctx, Rd, Rn, Operand2, I, S);
+ do_BIC: return BIC(ctx, Rd, Rn, Operand2, I, S);
+ do_MVN: return MVN(ctx, Rd, Rn, Operand2, I, S);
+ do_LSL: return LSL(ctx, Rd, Rn, Operand2, I, S);
+ do_LSR: return LSR(ctx, Rd, Rn, Operand2, I, S);
+ do_ASR: return ASR(ctx, Rd, Rn, Operand2, I, S);
+ do_ROR: return ROR(ctx, Rd, Rn, Operand2, I, S);
+ do_undef: return 1;
+#else
+  static dp_fn const dispatch[OP_ROR + 1] = {
+    AND, EOR, SUB, NULL, ADD, ADC, SBC, NULL,
+    TST, TEQ, CMP, CMN, ORR, MOV, BIC, MVN,
+    LSL, LSR, ASR, ROR
+  };
+
+  if (dispatch[d->op] == NULL)
+    return 1;
+  return dispatch[d->op](ctx, Rd, Rn, Operand2, I, S);
+#endif
 }
 
-  //Binary or command ORR
-  if(!strcmp(d_opcode,"1100")) {
-    printf("--- This is an ORR instruction. \n");
-    ORR(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+int branch_process(sim_context *ctx, const decoded_inst *d) {
 
+  /* This function execute branch instruction */
 
-  //Add with Carry ADC
-  if(!strcmp(d_opcode, "0101")) {
-    printf("--- This is an ADC instruction. \n");
-    ADC(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+  //bit 24 is the link bit, 1 for BL and 0 for B
+  int imm24 = d->imm24;
 
+  /* Add branch instructions here */
 
-  //Logical Left Shift LSL
-  if(!strcmp(d_opcode, "1101")) {
-    printf("--- This is an LSL instruction. \n");
-    LSL(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+    //Branch B
+    if(d->L == 0) {
+      B(ctx, imm24);
 
+      return 0;
+    }
 
-  //Subtract with Carry SBC
-  if(!strcmp(d_opcode, "0110")) {
-    printf("--- This is an SBC instruction. \n");
-    SBC(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+    //Branch with Link BL
+    if(d->L == 1) {
+      BL(ctx, imm24);
 
+      return 0;
+    }
 
-  //Compare Negative CMN
-  if(!strcmp(d_opcode, "1011")) {
-    printf("--- This is an CMN instruction. \n");
-    CMN(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+  return 1;
 
+}
 
-  //Logical Shift Right LSR
-  if(!strcmp(d_opcode, "1101")) {
-    printf("--- This is an LSR instruction. \n");
-    LSR(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+int mul_process(sim_context *ctx, const decoded_inst *d) {
 
+  /* This function execute multiply instruction */
 
-  //Compare CMP
-  if(!strcmp(d_opcode, "1010")) {
-    printf("--- This is an CMP instruction. \n");
-    CMP(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
+  /* Add multiply instructions here */
 
+  return 1;
 
-  //Move MOV
-  if(!strcmp(d_opcode, "1101")) {
-    printf("--- This is an MOV instruction. \n");
-    MOV(Rd, Operand2, I, S);
+}
 
-    return 0;
-  }
+int transfer_process(sim_context *ctx, const decoded_inst *d) {
 
+  /* This function execute memory instruction */
 
-  //Arithmetic Shift Right ASR
-  if(!strcmp(d_opcode, "1101")) {
-    printf("--- This is an ASR instruction. \n");
-    ASR(Rd, Rn, Operand2, I, S);
-    return 0;
-  }
+  int Rn = d->Rn;
+  int Rd = d->Rd;
+  int Operand2 = d->operand2;
 
 
-  //Bitwise Exclusive OR (XOR)
-  if(!strcmp(d_opcode, "0001")) {
-    printf("--- This is an EOR instruction. \n");
-    EOR(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
 
+  /* Add memory instructions here, interpretting the opcodes
+      and call a specific command in the ISA
+  */
 
-  //Bitwise NOT MVN
-  if(!strcmp(d_opcode, "1111")) {
-    printf("--- This is an MVN instruction. \n");
-    MVN(Rd, Rn, S);
+  //Store Register STR
+  if((d->B == 0) && (d->L == 0)) {
+    STR(ctx, Rd, Rn, Operand2, d->I, d->P, d->U, d->W);
     return 0;
   }
 
-  //Test Equivalence TEQ
-  if(!strcmp(d_opcode, "1001")) {
-    printf("--- This is an TEQ instruction. \n");
-    TEQ(Rd, Rn, Operand2, I, S, CC);
+  //Load Register LDR
+  if((d->B == 0) && (d->L == 1)) {
+    LDR(ctx, Rd, Rn, Operand2, d->I, d->P, d->U, d->W);
     return 0;
   }
 
-
-  //Bitwise Clear BIC
-  if(!strcmp(d_opcode, "1110")) {
-    printf("--- This is a BIC instruction. \n");
-    BIC(Rd, Rn, Operand2, S);
+  //Store Byte STRB
+  if((d->B == 1) && (d->L == 0)) {
+    STRB(ctx, Rd, Rn, Operand2, d->I, d->P, d->U, d->W);
     return 0;
   }
 
-  //Rotate Right ROR
-  if(!strcmp(d_opcode, "1101")) {
-    printf("--- This is an ROR instruction. \n");
-    ROR(Rd, Rn, Operand2, I, S, CC);
-    return 0;
-  }
 
+  // Load Byte LDRB
+  if((d->B == 1) && (d->L == 1)) {
+    LDRB(ctx, Rd, Rn, Operand2, d->I, d->P, d->U, d->W);
 
-  //Test TST
-  if(!strcmp(d_opcode, "1000")) {
-    printf("--- This is an TST instruction. \n");
-    TST(Rd, Rn, Operand2, I, S, CC);
     return 0;
   }
-
   return 1;
+
 }
 
-int branch_process(char* i_) {
+int interruption_process(sim_context *ctx, const decoded_inst *d) {
 
-  /* This function execute branch instruction */
+  SWI(ctx, d->word & 0x00FFFFFF);
+  ctx->ARCH_STATE.PC = ctx->CURRENT_STATE.PC - 4;
+  ctx->RUN_BIT = 0;
+  return 0;
 
-  //the 4 and 5 bits are operation and they are 10 for branch operations
+}
 
-  //funct code is 2 bits long plus a termination for the array
-  char func[3];
-  func[0] = 1;
-  func[1] = i_[7] - '0';
-  func[2] = '\0';
+int undefined_process(sim_context *ctx, const decoded_inst *d) {
 
+  return 1;
 
-  char imm[25]; imm[24] = '\0';
+}
 
-  //setting imm array
-  for(int i = 0; i < 24; i++) {
-    imm[i] = i_[8+i];
-  }
+/*
+   Class handler for a decoded instruction, stored in the predecode
+   cache so the class is only worked out once per text word.
+*/
+typedef int (*exec_fn)(sim_context *, const decoded_inst *);
 
-  int funct = bchar_to_int(func);
-  int imm24 = bchar_to_int(imm);
-  printf("imm24 = %d\n BL or B = %s\n", imm24, funct);
-  printf("\n");
+exec_fn decode_handler(const decoded_inst *d) {
 
-  /* Add branch instructions here */
+  switch (d->cls) {
+  case CLASS_BRANCH:   return branch_process;
+  case CLASS_MUL:      return mul_process;
+  case CLASS_DATA:     return data_process;
+  case CLASS_TRANSFER: return transfer_process;
+  case CLASS_SWI:      return interruption_process;
+  }
+  return undefined_process;
 
-    //Branch with Link BL
-    if((i_[7] == '0')) {
-      printf("--- This is an B instruction. \n");
-      B(imm24);
+}
 
-      return 0;
-    }
+/*
+   Predecode cache covering MEM_TEXT_START..+MEM_TEXT_SIZE, one entry
+   per word.  An entry is filled the first time its word is executed
+   and emptied (exec == NULL) when mem_write_32 stores to that word.
+*/
+typedef struct predecode_entry {
+  decoded_inst d;
+  exec_fn exec;
+} predecode_entry;
 
-    //Branch B
-    if((i_[7] == '1')) {
-      printf("--- This is an BL instruction. \n");
-      BL(imm24);
+#define PREDECODE_ENTRIES (MEM_TEXT_SIZE >> 2)
 
-      return 0;
-    }
+void predecode_invalidate(sim_context *ctx, uint32_t address) {
 
-  return 1;
+  uint32_t index = (address - MEM_TEXT_START) >> 2;
+  if (index < PREDECODE_ENTRIES) {
+    ctx->PREDECODE[index].exec = NULL;
+    ctx->BLOCKS_STALE = 1;
+  }
 
 }
 
-int mul_process(char* i_) {
+static predecode_entry *predecode_fetch(sim_context *ctx, uint32_t address, predecode_entry *scratch) {
 
-  /* This function execute multiply instruction */
-
-  /* Add multiply instructions here */
+  uint32_t index = (address - MEM_TEXT_START) >> 2;
+  predecode_entry *e = scratch;
 
-  return 1;
+  if (index < PREDECODE_ENTRIES && (address & 3) == 0) {
+    e = &ctx->PREDECODE[index];
+    if (e->exec != NULL)
+      return e;
+  }
+  decode(mem_read_32(ctx, address), &e->d);
+  e->exec = decode_handler(&e->d);
+  return e;
 
 }
 
-int transfer_process(char* i_) {
-
-  /* This function execute memory instruction */
-
-
-  //condition code is 4 bits long plus a terminaiton for the array
-  char d_cond[5];
-  d_cond[0] = i_[0];
-  d_cond[1] = i_[1];
-  d_cond[2] = i_[2];
-  d_cond[3] = i_[3];
-  d_cond[4] = '\0';
-
-  //the 4 and 5 bits are operation and they are 01 for memory operations
-
-  //opcode code is 4 bits long plus a termination for the array
-  char d_opcode[5];
-  d_opcode[0] = i_[7];
-  d_opcode[1] = i_[8];
-  d_opcode[2] = i_[9];
-  d_opcode[3] = i_[10];
-  d_opcode[5] = '\0';
-
-  char rn[5]; rn[4] = '\0';
-  char rd[5]; rd[4] = '\0';
-  char funct[7]; funct[6] = '\0';
-  char operand2[13]; operand2[12] = '\0';
-
-  //setting rn, rd, func, and operand2 arrays
-  for(int i = 0; i < 6; i++) {
-    funct[i] = i_[6+i];
-  }
-  for(int i = 0; i < 4; i++) {
-    rn[i] = i_[12+i];
-    rd[i] = i_[16+i];
-  }
-  for(int i = 0; i < 12; i++) {
-    operand2[i] = i_[20+i];
+#ifndef SIM_NO_TRACE
+
+/*
+   Print one executed instruction at the current TRACE_LEVEL:
+     instr  - the word and its mnemonic
+     decode - also the class and the decoded fields
+     full   - also the word in binary
+*/
+void trace_instruction(sim_context *ctx, const decoded_inst *d) {
+
+  fprintf(ctx->OUT, "The instruction is: %x \n", d->word);
+  if (ctx->TRACE_LEVEL >= TRACE_FULL) {
+    fprintf(ctx->OUT, "33222222222211111111110000000000\n");
+    fprintf(ctx->OUT, "10987654321098765432109876543210\n");
+    fprintf(ctx->OUT, "--------------------------------\n");
+    fprintf(ctx->OUT, "%s \n", byte_to_binary32(d->word));
+    fprintf(ctx->OUT, "\n");
+  }
+
+  if (ctx->TRACE_LEVEL >= TRACE_DECODE) {
+    switch (d->cls) {
+    case CLASS_DATA:
+      fprintf(ctx->OUT, "- This is a Data Processing Instruction. \n");
+      fprintf(ctx->OUT, "Opcode = %s\n", byte_to_binary4(d->opcode));
+      fprintf(ctx->OUT, " Rn = %d\n Rd = %d\n Operand2 = %s\n I = %d\n S = %d\n COND = %s\n",
+             d->Rn, d->Rd, byte_to_binary12(d->operand2), d->I, d->S, byte_to_binary4(d->cond));
+      fprintf(ctx->OUT, "\n");
+      break;
+    case CLASS_BRANCH:
+      fprintf(ctx->OUT, "- This is a Branch Instruction. \n");
+      fprintf(ctx->OUT, "imm24 = %d\n BL or B = %d\n", d->imm24, d->L);
+      fprintf(ctx->OUT, "\n");
+      break;
+    case CLASS_TRANSFER:
+      fprintf(ctx->OUT, "- This is a Single Data Transfer Instruction. \n");
+      fprintf(ctx->OUT, "CC = %s\n", byte_to_binary4(d->cond));
+      fprintf(ctx->OUT, " Rn = %d\n Rd = %d\n Operand2 = %s\n IPUBWL = %d%d%d%d%d%d\n",
+             d->Rn, d->Rd, byte_to_binary12(d->operand2), d->I, d->P, d->U, d->B, d->W, d->L);
+      fprintf(ctx->OUT, "\n");
+      break;
+    case CLASS_MUL:
+      fprintf(ctx->OUT, "- This is a Multiply Instruction. \n");
+      break;
+    case CLASS_SWI:
+      fprintf(ctx->OUT, "- This is a Software Interruption Instruction. \n");
+      break;
+    default:
+      fprintf(ctx->OUT, "- This is an unsupported Instruction. \n");
+      break;
+    }
   }
 
-  int CC = bchar_to_int(d_cond);
-  int func = bchar_to_int(funct);
-  int Rn = bchar_to_int(rn);
-  int Rd = bchar_to_int(rd);
-  int Operand2 = bchar_to_int(operand2);
+  fprintf(ctx->OUT, "--- This is an %s instruction. \n", OP_NAMES[d->op]);
 
-  printf("CC = %s\n Rn = %d\n Rd = %d\n Operand2 = %s\n IPUBWL = %s\n", CC, Rn, Rd, byte_to_binary12(Operand2), func);
-  printf("\n");
+}
 
+#endif
+
+/*
+   Run the predecoded instruction at pc.  The condition is checked here,
+   once, so a failing instruction never reaches its handler.  R15 reads
+   as pc + 8 while it executes; afterwards the PC is pc + 4 unless the
+   instruction wrote it (writes_pc and the handler succeeded).  The
+   fetch goes through the I-cache model and, with -p, the outcome is
+   counted first.  With --bpred, whatever may write the PC then shows
+   the predictor where it went, and with --timing the pipeline model
+   times it.  The binary trace (--trace-file) records it last.
+*/
+static inline void execute(sim_context *ctx, predecode_entry *e, uint32_t pc) {
+
+  int passed = cond_passed(ctx, e->d.cond);
+  int mispredicted = 0;
+
+  cache_fetch(ctx, pc);
+  if (ctx->PROFILE != NULL)
+    profile_count(ctx->PROFILE, &e->d, pc, passed);
+  ctx->CURRENT_STATE.PC = pc + 8;
+  if (!passed || e->exec(ctx, &e->d) != 0 || !e->d.writes_pc)
+    ctx->ARCH_STATE.PC = pc + 4;
+  if (e->d.writes_pc && ctx->BPRED != NULL)
+    mispredicted = bpred_branch(ctx->BPRED, &e->d, pc, ctx->ARCH_STATE.PC);
+  if (ctx->TIMING != NULL)
+    timing_step(ctx, &e->d, pc, passed, mispredicted);
+  if (ctx->BTRACE != NULL)
+    btrace_step(ctx, pc, e->d.word, passed, flags_nzcv(ctx));
 
-  /* Add memory instructions here, interpretting the opcodes
-      and call a specific command in the ISA
-  */
+}
 
-  //Store Register STR
-  if((i_[9] == '0') && (i_[11] == '0')) {
-    printf("--- This is an STR instruction. \n");
-    STR(Rd, Rn, Operand2, funct[0]);
-    return 0;
-  }
+/*
+   Basic block cache for the block execution mode (-b).  A block is a
+   straight run of predecoded text words ending at the first one that
+   may write the PC (B, BL, SWI, data processing or load into R15) or
+   at BLOCK_MAX_OPS.  Its ops are the PREDECODE entries themselves.
 
-  //Load Register LDR
-  if((i_[9] == '0') && (i_[11] == '1')) {
-    printf("--- This is an LDR instruction. \n");
-    LDR(Rd, Rn, Operand2, funct[0]);
-    return 0;
-  }
+   Each block remembers the last two blocks control went to next, so
+   steady loops go block to block without a BLOCK_MAP lookup.  Any
+   store into the text region marks the cache stale; run_blocks drops
+   every block before running another one.
+*/
+#define BLOCK_MAX_OPS 256
 
-  //Store Byte STRB
-  if((i_[9] == '1') && (i_[11] == '0')) {
-    printf("--- This is an STRB instruction. \n");
-    STRB(Rd, Rn, Operand2, funct[0]);
-    return 0;
-  }
+typedef struct sim_block {
+  uint32_t start;             /* address of the first op */
+  uint32_t count;             /* ops in the block */
+  predecode_entry *ops;       /* &ctx->PREDECODE[start index] */
+  struct sim_block *next[2];  /* chained successors, most recent first */
+  struct sim_block *all;      /* every live block, for flushing */
+} sim_block;
 
+static void block_flush(sim_context *ctx) {
 
-  // Load Byte LDRB
-  if((i_[9] == '1') && (i_[11] == '1')) {
-    printf("--- This is an LDRB instruction. \n");
-    LDRB(Rd, Rn, Operand2, funct[0]);
+  sim_block *b;
 
-    return 0;
+  while ((b = ctx->BLOCK_LIST) != NULL) {
+    ctx->BLOCK_LIST = b->all;
+    ctx->BLOCK_MAP[(b->start - MEM_TEXT_START) >> 2] = NULL;
+    free(b);
   }
-  return 1;
+  ctx->BLOCKS_STALE = 0;
 
 }
 
-int interruption_process(char* i_) {
+/*
+   Allocate the context's predecode cache and block map, PREDECODE_ENTRIES
+   each (ctx->BLOCKS_STALE is set when text changes under the block
+   cache, see run_blocks).
+*/
+void predecode_init(sim_context *ctx) {
 
-  SWI(i_);
-  RUN_BIT = 0;
-  return 0;
+  ctx->PREDECODE = calloc(PREDECODE_ENTRIES, sizeof(predecode_entry));
+  ctx->BLOCK_MAP = calloc(PREDECODE_ENTRIES, sizeof(sim_block *));
+  ctx->BLOCK_LIST = NULL;
+  ctx->BLOCKS_STALE = 0;
 
 }
 
-unsigned int COND(unsigned int i_word) {
+void predecode_free(sim_context *ctx) {
 
-  return (i_word>>28);
+  block_flush(ctx);
+  free(ctx->BLOCK_MAP);
+  free(ctx->PREDECODE);
 
 }
 
-unsigned int OPCODE(unsigned int i_word) {
+/* Block starting at address, built on first use.  NULL outside text. */
+static sim_block *block_lookup(sim_context *ctx, uint32_t address) {
+
+  uint32_t index = (address - MEM_TEXT_START) >> 2;
+  predecode_entry scratch;
+  sim_block *b;
+  uint32_t i;
+
+  if (index >= PREDECODE_ENTRIES || (address & 3) != 0)
+    return NULL;
+  if (ctx->BLOCK_MAP[index] != NULL)
+    return ctx->BLOCK_MAP[index];
+
+  b = malloc(sizeof(sim_block));
+  b->start = address;
+  b->ops = &ctx->PREDECODE[index];
+  b->next[0] = b->next[1] = NULL;
+  for (i = 0; i < BLOCK_MAX_OPS && index + i < PREDECODE_ENTRIES; i++) {
+    predecode_entry *e = predecode_fetch(ctx, address + 4 * i, &scratch);
+    if (e->d.writes_pc) {
+      i++;
+      break;
+    }
+  }
+  b->count = i;
 
-  return ((i_word<<7)>>27);
+  b->all = ctx->BLOCK_LIST;
+  ctx->BLOCK_LIST = b;
+  ctx->BLOCK_MAP[index] = b;
+  return b;
 
 }
 
+/*
+   Execute up to num_cycles instructions a block at a time, stopping
+   early when the program halts.  Each op is committed exactly as
+   cycle() would.  Falls back to process_instruction for PCs outside
+   the text region.  Returns the number of instructions executed.
+*/
+int run_blocks(sim_context *ctx, int num_cycles) {
 
-int decode_and_execute(char* i_) {
+  sim_block *b = NULL, *prev = NULL;
+  int done = 0;
 
-  /*
-     This function decode the instruction and update
-     CPU_State (NEXT_STATE)
-  */
+  while (done < num_cycles && ctx->RUN_BIT) {
+    uint32_t pc = ctx->CURRENT_STATE.PC;
+    uint32_t i, limit;
 
-  if((i_[4] == '1') && (i_[5] == '0') && (i_[6] == '1')) {
-    printf("- This is a Branch Instruction. \n");
-    branch_process(i_);
-  }
-  if((i_[4] == '0') && (i_[5] == '0') && (i_[6] == '0') && (i_[7] == '0') && (i_[24] == '1') && (i_[25] == '0') && (i_[26] == '0') && (i_[27] == '1')) {
-    printf("- This is a Multiply Instruction. \n");
-    mul_process(i_);
-  }
-  else {
-    printf("- This is a Data Processing Instruction. \n");
-    data_process(i_);
-  }
-  if((i_[4] == '0') && (i_[5] == '1')) {
-    printf("- This is a Single Data Transfer Instruction. \n");
-    transfer_process(i_);
-  }
-  if((i_[4] == '1') && (i_[5] == '1') && (i_[6] == '1') && (i_[7] == '1')) {
-    printf("- This is a Software Interruption Instruction. \n");
-    interruption_process(i_);
+    if (ctx->BLOCKS_STALE) {
+      block_flush(ctx);
+      prev = NULL;
+    }
+
+    /* follow the chain from the previous block, else look it up */
+    if (prev != NULL && prev->next[0] != NULL && prev->next[0]->start == pc)
+      b = prev->next[0];
+    else if (prev != NULL && prev->next[1] != NULL && prev->next[1]->start == pc) {
+      b = prev->next[1];
+      prev->next[1] = prev->next[0];
+      prev->next[0] = b;
+    }
+    else {
+      b = block_lookup(ctx, pc);
+      if (b == NULL) {
+        process_instruction(ctx);
+        COMMIT_STATE(ctx);
+        ctx->INSTRUCTION_COUNT++;
+        done++;
+        prev = NULL;
+        continue;
+      }
+      if (prev != NULL) {
+        prev->next[1] = prev->next[0];
+        prev->next[0] = b;
+      }
+    }
+
+    limit = b->count;
+    if (limit > (uint32_t)(num_cycles - done))
+      limit = num_cycles - done;
+
+    for (i = 0; i < limit; i++) {
+      predecode_entry *e = &b->ops[i];
+#ifndef SIM_NO_TRACE
+      if (ctx->TRACE_LEVEL != TRACE_NONE)
+        trace_instruction(ctx, &e->d);
+#endif
+      execute(ctx, e, b->start + 4 * i);
+      COMMIT_STATE(ctx);
+      ctx->INSTRUCTION_COUNT++;
+      if (ctx->BLOCKS_STALE) {
+        i++;
+        break;
+      }
+    }
+    done += i;
+    prev = ctx->BLOCKS_STALE ? NULL : b;
   }
-  return 0;
+  return done;
 
 }
 
-void process_instruction() {
+void process_instruction(sim_context *ctx) {
 
   /*
-     execute one instruction here. You should use CURRENT_STATE and modify
-     values in NEXT_STATE. You can call mem_read_32() and mem_write_32() to
-     access memory.
+     execute one instruction here. Handlers read CURRENT_STATE and
+     write ARCH_STATE (see shell.h). You can call mem_read_32() and
+     mem_write_32() to access memory.
   */
 
-  unsigned int inst_word = mem_read_32(CURRENT_STATE.PC);
-  printf("The instruction is: %x \n", inst_word);
-  printf("33222222222211111111110000000000\n");
-  printf("10987654321098765432109876543210\n");
-  printf("--------------------------------\n");
-  printf("%s \n", byte_to_binary32(inst_word));
-  printf("\n");
-  decode_and_execute(byte_to_binary32(inst_word));
+  uint32_t pc = ctx->CURRENT_STATE.PC;
+  predecode_entry scratch;
+  predecode_entry *e = predecode_fetch(ctx, pc, &scratch);
 
-  NEXT_STATE.PC += 4;
+#ifndef SIM_NO_TRACE
+  if (ctx->TRACE_LEVEL != TRACE_NONE)
+    trace_instruction(ctx, &e->d);
+#endif
+  execute(ctx, e, pc);
 
 }
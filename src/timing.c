@@ -0,0 +1,242 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "timing.h"
+
+static const char *STALL_NAMES[STALL_KINDS] = { "data", "load-use", "multiply", "branch" };
+
+static void timing_defaults (timing_config *config) {
+
+  int k;
+
+  for (k = 0; k < OP_COUNT; k++)
+    config->latency[k] = 1;
+  config->latency[OP_LDR] = 2;
+  config->latency[OP_LDRB] = 2;
+  config->latency[OP_MUL] = 3;
+  config->latency[OP_MLA] = 4;
+  config->branch_penalty = 2;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : timing_load                                     */
+/*                                                             */
+/* Purpose   : Read latencies over the defaults.  Each line is */
+/*             a mnemonic and its latency in cycles, or        */
+/*             branch_penalty and a cycle count; blank lines   */
+/*             and # comments are skipped:                     */
+/*                                                             */
+/*               # slow multiplier                             */
+/*               MUL 5                                         */
+/*               branch_penalty 3                              */
+/*                                                             */
+/*             Errors go to err.  Returns -1 on a bad file.    */
+/*                                                             */
+/***************************************************************/
+int timing_load (const char *filename, timing_config *config, FILE * err) {
+
+  FILE *in;
+  char line[COMMAND_LINE_MAX], name[16];
+  unsigned int cycles;
+  int line_no = 0, k, status = 0;
+
+  timing_defaults(config);
+  if ((in = fopen(filename, "r")) == NULL) {
+    fprintf(err, "Error: Can't open timing file %s\n", filename);
+    return -1;
+  }
+  while (status == 0 && fgets(line, sizeof(line), in) != NULL) {
+    line_no++;
+    if (sscanf(line, "%15s", name) != 1 || name[0] == '#')
+      continue;
+    if (sscanf(line, "%*s %u", &cycles) != 1 || cycles == 0) {
+      fprintf(err, "Error: %s:%d: want a name and a cycle count\n", filename, line_no);
+      status = -1;
+      break;
+    }
+    if (!strcasecmp(name, "branch_penalty")) {
+      config->branch_penalty = cycles;
+      continue;
+    }
+    for (k = 0; k < OP_COUNT; k++)
+      if (!strcasecmp(name, OP_NAMES[k]))
+        break;
+    if (k == OP_COUNT) {
+      fprintf(err, "Error: %s:%d: unknown mnemonic %s\n", filename, line_no, name);
+      status = -1;
+    }
+    else
+      config->latency[k] = cycles;
+  }
+  fclose(in);
+  return status;
+}
+
+void timing_enable (sim_context *ctx, const timing_config *config) {
+
+  timing_free(ctx);
+  ctx->TIMING = calloc(1, sizeof(sim_timing));
+  ctx->TIMING->config = *config;
+}
+
+void timing_free (sim_context *ctx) {
+
+  free(ctx->TIMING);
+  ctx->TIMING = NULL;
+}
+
+/* wait in EX until register r can be forwarded */
+static void timing_wait (sim_timing *t, uint64_t *ex, int r) {
+
+  if (t->ready[r] > *ex) {
+    t->stalls[t->producer[r]] += t->ready[r] - *ex;
+    *ex = t->ready[r];
+  }
+}
+
+/* r can be forwarded from cycle ready on (the PC never waits) */
+static void timing_result (sim_timing *t, int r, uint64_t ready, int producer) {
+
+  if (r == 15)
+    return;
+  t->ready[r] = ready;
+  t->producer[r] = producer;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : timing_step                                     */
+/*                                                             */
+/* Purpose   : Time the instruction d at pc, which execute()   */
+/*             just ran (passed: its condition held) and       */
+/*             which, with --bpred, was mispredicted.          */
+/*                                                             */
+/***************************************************************/
+void timing_step (sim_context *ctx, const decoded_inst *d, uint32_t pc, int passed,
+                  int mispredicted) {
+
+  sim_timing *t = ctx->TIMING;
+  uint32_t latency = t->config.latency[d->op];
+  uint64_t ex = t->next_ex;
+  int producer = STALL_DATA;
+
+  /* operands */
+  if (d->cond != COND_AL)
+    timing_wait(t, &ex, TIMING_FLAGS);
+  switch (d->cls) {
+  case CLASS_DATA:
+    if (d->opcode != OP_MOV && d->opcode != OP_MVN)
+      timing_wait(t, &ex, d->Rn);
+    if (d->I == 0) {
+      timing_wait(t, &ex, d->Rm);
+      if (d->bit4)
+        timing_wait(t, &ex, d->Rs);
+    }
+    if (d->opcode == OP_ADC || d->opcode == OP_SBC || d->opcode == OP_RSC)
+      timing_wait(t, &ex, TIMING_FLAGS);
+    break;
+  case CLASS_MUL:
+    /* Rd is 19:16 and the accumulator 15:12 for multiplies */
+    timing_wait(t, &ex, d->Rm);
+    timing_wait(t, &ex, d->Rs);
+    if (d->op == OP_MLA)
+      timing_wait(t, &ex, d->Rd);
+    producer = STALL_MULTIPLY;
+    break;
+  case CLASS_TRANSFER:
+    timing_wait(t, &ex, d->Rn);
+    if (d->I == 1)
+      timing_wait(t, &ex, d->Rm);
+    if (!d->L)
+      timing_wait(t, &ex, d->Rd);
+    else
+      producer = STALL_LOAD_USE;
+    break;
+  }
+
+  /* results */
+  if (passed) {
+    switch (d->cls) {
+    case CLASS_DATA:
+      if (d->opcode < OP_TST || d->opcode > OP_CMN)
+        timing_result(t, d->Rd, ex + latency, producer);
+      if (d->S)
+        timing_result(t, TIMING_FLAGS, ex + latency, producer);
+      break;
+    case CLASS_MUL:
+      timing_result(t, d->Rn, ex + latency, producer);
+      if (d->S)
+        timing_result(t, TIMING_FLAGS, ex + latency, producer);
+      break;
+    case CLASS_TRANSFER:
+      if (!d->P || d->W)
+        timing_result(t, d->Rn, ex + 1, STALL_DATA);
+      if (d->L)
+        timing_result(t, d->Rd, ex + latency, producer);
+      break;
+    case CLASS_BRANCH:
+      if (d->L)
+        timing_result(t, 14, ex + latency, producer);
+      break;
+    }
+  }
+
+  /* leave EX; a multiply holds it for its whole latency */
+  t->next_ex = ex + 1;
+  if (d->cls == CLASS_MUL && latency > 1) {
+    t->next_ex += latency - 1;
+    t->stalls[STALL_MULTIPLY] += latency - 1;
+  }
+
+  /* refetch behind a branch resolved in EX */
+  if (d->writes_pc && d->cls != CLASS_SWI &&
+      (ctx->BPRED != NULL ? mispredicted : ctx->ARCH_STATE.PC != pc + 4)) {
+    t->next_ex += t->config.branch_penalty;
+    t->stalls[STALL_BRANCH] += t->config.branch_penalty;
+  }
+  t->instructions++;
+}
+
+/***************************************************************/
+/*                                                             */
+/* Procedure : timing_report                                   */
+/*                                                             */
+/* Purpose   : Print cycles, CPI and where the stalls came     */
+/*             from.  Cycles are one per instruction, plus the */
+/*             stalls, plus TIMING_FILL for the first one to   */
+/*             get through the pipeline.                       */
+/*                                                             */
+/***************************************************************/
+void timing_report (sim_context *ctx, FILE * out) {
+
+  sim_timing *t = ctx->TIMING;
+  uint64_t cycles = t->instructions ? t->next_ex + TIMING_FILL : 0;
+  int k;
+
+  fprintf(out, "Pipeline timing : 5-stage in-order, forwarding, branch penalty %u%s\n",
+          t->config.branch_penalty, ctx->BPRED != NULL ? " on mispredicts" : " on taken branches");
+  fprintf(out, "-------------------------------------\n");
+  fprintf(out, "Instructions      : %llu\n", (unsigned long long)t->instructions);
+  fprintf(out, "Cycles            : %llu\n", (unsigned long long)cycles);
+  if (t->instructions != 0)
+    fprintf(out, "CPI               : %.3f\n", (double)cycles / t->instructions);
+  fprintf(out, "Stall cycles      :\n");
+  for (k = 0; k < STALL_KINDS; k++)
+    fprintf(out, "  %-15s : %llu\n", STALL_NAMES[k], (unsigned long long)t->stalls[k]);
+  fprintf(out, "  %-15s : %d\n", "pipeline fill", t->instructions ? TIMING_FILL : 0);
+  fprintf(out, "\n");
+}
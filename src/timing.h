@@ -0,0 +1,67 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+#ifndef _SIM_TIMING_H_
+#define _SIM_TIMING_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "shell.h"
+#include "decode.h"
+
+/*
+   Pipeline timing model (--timing), hung off ctx->TIMING while
+   enabled.  It times the instructions execute() runs on a classic
+   5-stage in-order pipeline (IF ID EX MEM WB) with full forwarding:
+   each instruction enters EX as soon as the one before has left it
+   and its operands can be forwarded, and nothing else is simulated,
+   so the functional results never depend on it.
+
+   latency[op] is the number of cycles from entering EX until op's
+   result can be forwarded: 1 for the ALU, 2 for loads (the value
+   comes out of MEM, so a dependent instruction right behind stalls
+   one cycle).  Multiplies hold EX for their whole latency.  A taken
+   branch, or with --bpred a mispredicted one, costs branch_penalty
+   cycles of refetch.
+*/
+typedef struct {
+  uint32_t latency[OP_COUNT];
+  uint32_t branch_penalty;
+} timing_config;
+
+/* where stall cycles went */
+#define STALL_DATA     0	/* waiting on a multi-cycle ALU result */
+#define STALL_LOAD_USE 1	/* waiting on a load */
+#define STALL_MULTIPLY 2	/* behind a multiply in EX, or waiting on its result */
+#define STALL_BRANCH   3	/* refetching after a branch */
+#define STALL_KINDS    4
+
+/* the flags are scoreboarded like a register */
+#define TIMING_FLAGS ARM_REGS
+
+typedef struct sim_timing {
+  timing_config config;
+  uint64_t next_ex;		/* first cycle the next instruction may enter EX */
+  uint64_t ready[ARM_REGS + 1];	/* cycle each register (and the flags) can be forwarded */
+  uint8_t producer[ARM_REGS + 1];	/* STALL_* charged for waiting on it */
+  uint64_t instructions;
+  uint64_t stalls[STALL_KINDS];
+} sim_timing;
+
+/* the five stages fill before the first instruction retires */
+#define TIMING_FILL 4
+
+int  timing_load (const char *filename, timing_config *config, FILE * err);
+void timing_enable (sim_context *ctx, const timing_config *config);
+void timing_free (sim_context *ctx);
+void timing_report (sim_context *ctx, FILE * out);
+void timing_step (sim_context *ctx, const decoded_inst *d, uint32_t pc, int passed, int mispredicted);
+
+#endif
@@ -0,0 +1,249 @@
+/***************************************************************/
+/*                                                             */
+/*   ARMv8-32 Instruction Level Simulator                      */
+/*                                                             */
+/*   ECEN 4243                                                 */
+/*   Oklahoma State University                                 */
+/*                                                             */
+/***************************************************************/
+
+/*
+   tracedump: print a --trace-file trace as text, one line per
+   instruction, optionally only the ones matching every filter given:
+
+     tracedump [-p low:high] [-r reg] [-m] [-n count] trace
+
+     -p  pc between low and high (inclusive)
+     -r  writes register reg
+     -m  loads or stores
+     -n  stop after count lines
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "btrace.h"
+#include "decode.h"
+
+#define READ_BUFFER (1 << 20)
+
+/* one decoded record */
+typedef struct {
+  uint8_t header;
+  uint32_t pc, word, nzcv;
+  int access_size;
+  uint32_t address, value;
+  int writes;
+  uint8_t reg[ARM_REGS];
+  uint32_t reg_value[ARM_REGS];
+} trace_record;
+
+/* the machine as far as the trace has told */
+typedef struct {
+  uint32_t pc, regs[ARM_REGS], nzcv, address;
+  btrace_words words;
+} trace_state;
+
+/* decode the record at p into rec; returns its length, 0 if cut short or bad */
+static size_t read_record (const uint8_t *p, const uint8_t *end, trace_state *s,
+                           trace_record *rec) {
+
+  const uint8_t *q = p + 1;
+  uint32_t n;
+  int k, r;
+
+  if (p >= end)
+    return 0;
+  rec->header = *p;
+  rec->access_size = 0;
+  rec->address = rec->value = 0;
+
+  /* a sync record has no instruction, only flags and writes */
+  if ((rec->header & BTRACE_SYNC) == BTRACE_SYNC)
+    rec->pc = rec->word = 0;
+  else {
+    rec->pc = s->pc + 4;
+    if (rec->header & BTRACE_JUMP) {
+      if ((k = varint_get(q, end, &n)) == 0)
+        return 0;
+      rec->pc += unzigzag(n);
+      q += k;
+    }
+    s->pc = rec->pc;
+
+    if (rec->header & BTRACE_WORD) {
+      if (end - q < 4)
+        return 0;
+      rec->word = q[0] | q[1] << 8 | q[2] << 16 | (uint32_t)q[3] << 24;
+      q += 4;
+    }
+    else
+      rec->word = s->words.word[(rec->pc >> 2) & (BTRACE_WORDS - 1)];
+    btrace_word_known(&s->words, rec->pc, rec->word);
+
+    if (rec->header & (BTRACE_LOAD | BTRACE_STORE)) {
+      if (q >= end)
+        return 0;
+      rec->access_size = *q++;
+      if ((k = varint_get(q, end, &n)) == 0)
+        return 0;
+      s->address += unzigzag(n);
+      rec->address = s->address;
+      q += k;
+      if ((k = varint_get(q, end, &rec->value)) == 0)
+        return 0;
+      q += k;
+    }
+  }
+
+  if (rec->header & BTRACE_FLAGS) {
+    if (q >= end)
+      return 0;
+    s->nzcv = *q++ & 0xf;
+  }
+  rec->nzcv = s->nzcv;
+
+  rec->writes = rec->header >> BTRACE_WRITES_SHIFT;
+  if (rec->writes == 3) {
+    if (q >= end)
+      return 0;
+    rec->writes = *q++;
+  }
+  if (rec->writes > ARM_REGS - 1)
+    return 0;
+  for (r = 0; r < rec->writes; r++) {
+    if (q >= end || *q > 14)
+      return 0;
+    rec->reg[r] = *q++;
+    if ((k = varint_get(q, end, &n)) == 0)
+      return 0;
+    q += k;
+    s->regs[rec->reg[r]] += unzigzag(n);
+    rec->reg_value[r] = s->regs[rec->reg[r]];
+  }
+  return q - p;
+}
+
+static void print_record (uint64_t index, const trace_record *rec) {
+
+  decoded_inst d;
+  int r;
+
+  if ((rec->header & BTRACE_SYNC) == BTRACE_SYNC)
+    printf("%10s  %-27s", "-", "sync");
+  else {
+    decode(rec->word, &d);
+    printf("%10llu  0x%08x  %08x  %-5s", (unsigned long long)index, rec->pc, rec->word,
+           OP_NAMES[d.op]);
+  }
+  if (rec->header & BTRACE_SKIPPED)
+    printf(" skipped");
+  for (r = 0; r < rec->writes; r++)
+    printf(" r%d=0x%08x", rec->reg[r], rec->reg_value[r]);
+  if (rec->access_size != 0)
+    printf(" %s%s[0x%08x]=0x%0*x", rec->header & BTRACE_STORE ? "st" : "ld",
+           rec->access_size == 1 ? "b" : "", rec->address, 2 * rec->access_size, rec->value);
+  if (rec->header & BTRACE_FLAGS)
+    printf(" nzcv=%c%c%c%c", rec->nzcv & 8 ? 'N' : 'n', rec->nzcv & 4 ? 'Z' : 'z',
+           rec->nzcv & 2 ? 'C' : 'c', rec->nzcv & 1 ? 'V' : 'v');
+  printf("\n");
+}
+
+static void usage (char *name) {
+
+  fprintf(stderr, "Usage: %s [-p low:high] [-r reg] [-m] [-n count] trace\n", name);
+  exit(1);
+}
+
+int main (int argc, char *argv[]) {
+
+  FILE *in;
+  uint8_t *buffer = malloc(READ_BUFFER);
+  size_t have = 0, at = 0, got, length;
+  trace_state state;
+  trace_record rec;
+  uint64_t index = 0, printed = 0, limit = UINT64_MAX;
+  uint32_t low = 0, high = UINT32_MAX;
+  int arg = 1, reg = -1, memory = 0, r, match;
+  char *end;
+
+  while (arg < argc && argv[arg][0] == '-') {
+    if (!strcmp(argv[arg], "-p") && arg + 1 < argc) {
+      low = strtoul(argv[arg + 1], &end, 0);
+      if (*end != ':')
+        usage(argv[0]);
+      high = strtoul(end + 1, &end, 0);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-r") && arg + 1 < argc) {
+      reg = atoi(argv[arg + 1]);
+      arg += 2;
+    }
+    else if (!strcmp(argv[arg], "-m")) {
+      memory = 1;
+      arg++;
+    }
+    else if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+      limit = strtoull(argv[arg + 1], NULL, 0);
+      arg += 2;
+    }
+    else
+      usage(argv[0]);
+  }
+  if (arg + 1 != argc)
+    usage(argv[0]);
+
+  if ((in = fopen(argv[arg], "rb")) == NULL) {
+    fprintf(stderr, "Error: Can't open trace file %s\n", argv[arg]);
+    exit(1);
+  }
+  if (fread(buffer, 1, 8, in) != 8 || memcmp(buffer, BTRACE_MAGIC, 8)) {
+    fprintf(stderr, "Error: %s is not a trace\n", argv[arg]);
+    exit(1);
+  }
+
+  memset(&state, 0, sizeof(state));
+  while (printed < limit) {
+    /* keep at least a whole record in the buffer */
+    if (have - at < BTRACE_RECORD_MAX) {
+      memmove(buffer, buffer + at, have - at);
+      have -= at;
+      at = 0;
+      if ((got = fread(buffer + have, 1, READ_BUFFER - have, in)) > 0)
+        have += got;
+      if (have == 0)
+        break;
+    }
+    if ((length = read_record(buffer + at, buffer + have, &state, &rec)) == 0) {
+      fprintf(stderr, "Error: %s: bad or truncated record %llu\n", argv[arg],
+              (unsigned long long)index);
+      exit(1);
+    }
+    at += length;
+
+    /* sync records only show with no -p or -m */
+    if ((rec.header & BTRACE_SYNC) == BTRACE_SYNC)
+      match = low == 0 && high == UINT32_MAX && !memory;
+    else
+      match = rec.pc >= low && rec.pc <= high;
+    if (memory && rec.access_size == 0)
+      match = 0;
+    if (reg >= 0) {
+      for (r = 0; r < rec.writes && rec.reg[r] != reg; r++)
+        ;
+      if (r == rec.writes)
+        match = 0;
+    }
+    if (match) {
+      print_record(index, &rec);
+      printed++;
+    }
+    if ((rec.header & BTRACE_SYNC) != BTRACE_SYNC)
+      index++;
+  }
+  fclose(in);
+  free(buffer);
+  return 0;
+}